@@ -0,0 +1,110 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <vector>
+
+/// Bump allocator for data that is only needed while loading. Memory comes
+/// from large blocks and is given back all at once by release().
+class Arena
+{
+public:
+    static const size_t BLOCK_SIZE = 4 << 20;
+
+    Arena() : mHead(0), mLeft(0), mUsed(0), mReserved(0), mPeak(0) { }
+    ~Arena() { release(); }
+
+    void* alloc(size_t bytes, size_t align = 16)
+    {
+        size_t pad = (align - (size_t) mHead % align) % align;
+        if (!mHead || pad + bytes > mLeft)
+        {
+            size_t size = bytes + align > BLOCK_SIZE ? bytes + align : BLOCK_SIZE;
+            mHead = (char*) malloc(size);
+            if (!mHead)
+                abort();
+            mBlocks.push_back(mHead);
+            mLeft = size;
+            mReserved += size;
+            mPeak = mReserved > mPeak ? mReserved : mPeak;
+            pad = (align - (size_t) mHead % align) % align;
+        }
+        void* p = mHead + pad;
+        mHead += pad + bytes;
+        mLeft -= pad + bytes;
+        mUsed += bytes;
+        return p;
+    }
+
+    /// Frees every allocation. Nothing taken from the arena may be used
+    /// afterwards.
+    void release()
+    {
+        for (size_t i = 0; i < mBlocks.size(); i++)
+            free(mBlocks[i]);
+        std::vector<char*>().swap(mBlocks);
+        mHead = 0;
+        mLeft = 0;
+        mUsed = 0;
+        mReserved = 0;
+    }
+
+    size_t used() const { return mUsed; }
+    size_t reserved() const { return mReserved; }
+    size_t peak() const { return mPeak; } // most ever reserved at once
+
+private:
+    Arena(const Arena&);
+    Arena& operator=(const Arena&);
+
+    std::vector<char*> mBlocks;
+    char* mHead;
+    size_t mLeft;
+    size_t mUsed, mReserved, mPeak;
+};
+
+/// Append-only array stored in an Arena in fixed-size chunks, so growing it
+/// never moves or copies what is already there. T must be trivially
+/// copyable. Call clear() before the arena is released.
+template <typename T>
+class ArenaList
+{
+public:
+    static const size_t CHUNK = 16384; // elements
+
+    explicit ArenaList(Arena& arena) : mArena(arena), mSize(0) { }
+
+    void push_back(const T& value)
+    {
+        if (mSize % CHUNK == 0)
+            mChunks.push_back((T*) mArena.alloc(CHUNK * sizeof(T), alignof(T)));
+        mChunks[mSize / CHUNK][mSize % CHUNK] = value;
+        mSize++;
+    }
+
+    size_t size() const { return mSize; }
+    bool empty() const { return mSize == 0; }
+
+    T& operator[](size_t i) { return mChunks[i / CHUNK][i % CHUNK]; }
+    const T& operator[](size_t i) const { return mChunks[i / CHUNK][i % CHUNK]; }
+
+    /// Contiguous pieces, for copying the whole list out in bulk.
+    size_t numChunks() const { return mChunks.size(); }
+    T* chunk(size_t c) { return mChunks[c]; }
+    const T* chunk(size_t c) const { return mChunks[c]; }
+    size_t chunkSize(size_t c) const { return c + 1 < mChunks.size() ? CHUNK : mSize - c * CHUNK; }
+
+    void clear()
+    {
+        std::vector<T*>().swap(mChunks);
+        mSize = 0;
+    }
+
+private:
+    Arena& mArena;
+    std::vector<T*> mChunks;
+    size_t mSize;
+};
+
+#endif
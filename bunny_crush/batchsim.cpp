@@ -0,0 +1,166 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+#include "board.h"
+
+// Plays many independent games with the rules in board.h across a pool of
+// threads and prints aggregate statistics.
+//
+//   ./batchsim <games> <grid_width> <grid_height> [threads] [seed] [max_moves]
+//
+// Each game gets its own board and generator seeded from (seed, game
+// index), so results do not depend on the thread count. The simulated
+// player clicks a random productive move; a game ends when no productive
+// move is left or after max_moves moves.
+
+const int MAX_TRACKED = 256; // histogram buckets; larger values are clamped
+
+// aligned so per-thread counters do not share cache lines
+struct alignas(64) Stats
+{
+    Stats() : games(0), moves(0), score(0), cascadeRounds(0)
+    {
+        scoreHist.assign(MAX_TRACKED * 16, 0);
+        cascadeHist.assign(MAX_TRACKED, 0);
+        movesHist.assign(MAX_TRACKED * 16, 0);
+    }
+
+    void merge(const Stats& other)
+    {
+        games += other.games;
+        moves += other.moves;
+        score += other.score;
+        cascadeRounds += other.cascadeRounds;
+        for (size_t i = 0; i < scoreHist.size(); i++)
+            scoreHist[i] += other.scoreHist[i];
+        for (size_t i = 0; i < cascadeHist.size(); i++)
+            cascadeHist[i] += other.cascadeHist[i];
+        for (size_t i = 0; i < movesHist.size(); i++)
+            movesHist[i] += other.movesHist[i];
+    }
+
+    long long games, moves, score, cascadeRounds;
+    std::vector<long long> scoreHist;   // final score per game
+    std::vector<long long> cascadeHist; // cascade rounds per move
+    std::vector<long long> movesHist;   // moves per game
+};
+
+static void add(std::vector<long long>& hist, int value)
+{
+    hist[std::min<int>(value, hist.size() - 1)]++;
+}
+
+static int percentile(const std::vector<long long>& hist, long long total, double p)
+{
+    long long target = (long long) (p * total);
+    long long seen = 0;
+    for (size_t i = 0; i < hist.size(); i++)
+    {
+        seen += hist[i];
+        if (seen > target)
+            return i;
+    }
+    return hist.size() - 1;
+}
+
+static void playGame(int rows, int cols, uint64_t seed, int maxMoves, Stats& stats)
+{
+    Rng rng(seed);
+    std::vector<uint8_t> cells(rows * cols), matched(rows * cols, 0);
+    std::vector<int> candidates;
+    candidates.reserve(rows * cols);
+    MoveIndex index;
+
+    generateBoard(&cells[0], rows, cols, rng);
+
+    int moves = 0, score = 0;
+    for (; moves < maxMoves; moves++)
+    {
+        index.build(&cells[0], rows, cols);
+        if (!index.anyMove())
+            break;
+
+        candidates.clear();
+        for (int k = 0; k < rows * cols; k++)
+            if (index.isWitness(k / cols, k % cols))
+                candidates.push_back(k);
+
+        int k = candidates[rng.below(candidates.size())];
+        MoveResult result = playMove(&cells[0], &matched[0], rows, cols, k / cols, k % cols, rng);
+        score += result.score;
+        stats.cascadeRounds += result.cascades;
+        add(stats.cascadeHist, result.cascades);
+    }
+
+    stats.games++;
+    stats.moves += moves;
+    stats.score += score;
+    add(stats.scoreHist, score);
+    add(stats.movesHist, moves);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 4)
+    {
+        printf("Please run the program as:\n"
+               "\t./batchsim <games> <grid_width> <grid_height> [threads] [seed] [max_moves]\n");
+        return 1;
+    }
+
+    long long games = atoll(argv[1]);
+    int cols = atoi(argv[2]);
+    int rows = atoi(argv[3]);
+    int threads = argc > 4 ? atoi(argv[4]) : std::thread::hardware_concurrency();
+    uint64_t seed = argc > 5 ? strtoull(argv[5], NULL, 10) : 1;
+    int maxMoves = argc > 6 ? atoi(argv[6]) : 1000;
+    if (threads < 1)
+        threads = 1;
+
+    // workers grab games in chunks from a shared counter; each keeps its
+    // own statistics which are merged at the end
+    const long long CHUNK = 64;
+    std::atomic<long long> next(0);
+    std::vector<Stats> perThread(threads);
+    std::vector<std::thread> pool;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int t = 0; t < threads; t++)
+    {
+        pool.push_back(std::thread([&, t]() {
+            long long first;
+            while ((first = next.fetch_add(CHUNK)) < games)
+            {
+                long long last = std::min(first + CHUNK, games);
+                for (long long g = first; g < last; g++)
+                    playGame(rows, cols, seed * 0x9E3779B97F4A7C15ull + g, maxMoves, perThread[t]);
+            }
+        }));
+    }
+    for (int t = 0; t < threads; t++)
+        pool[t].join();
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    Stats total;
+    for (int t = 0; t < threads; t++)
+        total.merge(perThread[t]);
+
+    printf("games            %lld on %dx%d, %d threads\n", total.games, cols, rows, threads);
+    printf("throughput       %.0f games/s, %.0f moves/s\n", total.games / elapsed, total.moves / elapsed);
+    printf("moves per game   mean %.2f  p50 %d  p90 %d\n", (double) total.moves / total.games,
+           percentile(total.movesHist, total.games, 0.5), percentile(total.movesHist, total.games, 0.9));
+    printf("score            mean %.2f  p10 %d  p50 %d  p90 %d  p99 %d\n", (double) total.score / total.games,
+           percentile(total.scoreHist, total.games, 0.1), percentile(total.scoreHist, total.games, 0.5),
+           percentile(total.scoreHist, total.games, 0.9), percentile(total.scoreHist, total.games, 0.99));
+    printf("cascade rounds   mean %.3f per move  histogram",
+           total.moves ? (double) total.cascadeRounds / total.moves : 0.0);
+    for (int i = 0; i < 8; i++)
+        printf(" %d:%lld", i, total.cascadeHist[i]);
+    printf("\n");
+
+    return 0;
+}
@@ -0,0 +1,335 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include "board.h"
+#include "objloader.h"
+#include "transform.h"
+
+// Microbenchmarks for the hot paths. Prints one CSV row per case:
+//
+//   make bench && ./bench [--case <name>] [--sizes 8,9,10] [--mesh file.obj] [--runs n] [--generic]
+//
+// Cases are generate, match, match_stable, gravity, pop, transform (per grid size) and
+// parse (per mesh; generated spheres with and without normals if no --mesh
+// is given). Inputs come from fixed seeds. Each case is repeated until a
+// run takes long enough to time, then run several times; ms_min and
+// ms_median are per repetition and ns_per_item divides the best run by the
+// cells, tiles or triangles it handled. `build` tells optimized and debug
+// binaries apart in one file, and `kernel` tells which board kernels ran;
+// --generic turns the fixed-size ones off for comparison.
+
+static const double MIN_RUN_SECONDS = 0.02;
+
+static int gRuns = 5;
+static volatile uint64_t gSink; // keeps results alive
+
+static double nowSeconds()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static const char* buildName()
+{
+#if defined(__OPTIMIZE__) && defined(NDEBUG)
+    return "release";
+#elif defined(__OPTIMIZE__)
+    return "optimized";
+#else
+    return "debug";
+#endif
+}
+
+// Runs body(reps) and prints its row. `items` is the work of one repetition;
+// check() validates the result afterwards, outside the timing.
+template <typename Body, typename Check>
+static void measure(const char* name, const std::string& param, int rows, int cols, double items, Body body, Check check)
+{
+    // find a repetition count that runs for at least MIN_RUN_SECONDS
+    int reps = 1;
+    while (true)
+    {
+        double start = nowSeconds();
+        body(reps);
+        if (nowSeconds() - start >= MIN_RUN_SECONDS || reps >= (1 << 30))
+            break;
+        reps *= 2;
+    }
+
+    std::vector<double> ms(gRuns);
+    for (int r = 0; r < gRuns; r++)
+    {
+        double start = nowSeconds();
+        body(reps);
+        ms[r] = (nowSeconds() - start) * 1e3 / reps;
+    }
+    std::sort(ms.begin(), ms.end());
+
+    printf("%s,%s,%s,%s,%d,%d,%.0f,%d,%.6f,%.6f,%.3f,%s\n", name, buildName(), boardKernelName(rows, cols), param.c_str(),
+           rows, cols, items, reps, ms[0], ms[gRuns / 2], ms[0] * 1e6 / items, check() ? "ok" : "INVALID");
+}
+
+static void randomBoard(std::vector<uint8_t>& cells, Rng& rng)
+{
+    for (size_t i = 0; i < cells.size(); i++)
+        cells[i] = rng.below(NUM_COLORS);
+}
+
+static void benchGenerate(int size)
+{
+    std::vector<uint8_t> cells(size * size);
+    Rng rng(size);
+
+    measure("generate", std::to_string(size), size, size, size * size, [&](int reps) {
+        for (int r = 0; r < reps; r++)
+            generateBoard(&cells[0], size, size, rng);
+    }, [&] {
+        return !boardHasMatch(&cells[0], size, size) && boardHasMove(&cells[0], size, size);
+    });
+}
+
+// Match detection on a random board, which has plenty of runs.
+static void benchMatch(int size)
+{
+    std::vector<uint8_t> cells(size * size), matched(size * size);
+    Rng rng(size);
+    randomBoard(cells, rng);
+
+    int score = 0;
+    measure("match", std::to_string(size), size, size, size * size, [&](int reps) {
+        for (int r = 0; r < reps; r++)
+        {
+            memset(&matched[0], 0, matched.size());
+            score = markMatches(&cells[0], &matched[0], size, size);
+            gSink += score;
+        }
+    }, [&] {
+        return boardHasMatch(&cells[0], size, size) == (score > 0);
+    });
+}
+
+// Match detection on a board without runs, which is how every cascade
+// ends and most scans during play go.
+static void benchMatchStable(int size)
+{
+    std::vector<uint8_t> cells(size * size), matched(size * size, 0);
+    Rng rng(size);
+    generateBoard(&cells[0], size, size, rng);
+
+    int score = 0;
+    measure("match_stable", std::to_string(size), size, size, size * size, [&](int reps) {
+        for (int r = 0; r < reps; r++)
+        {
+            score = markMatches(&cells[0], &matched[0], size, size);
+            gSink += score;
+        }
+    }, [&] {
+        return score == 0;
+    });
+}
+
+// Removing the matches of a random board and refilling from the top. Each
+// repetition restores the board first; the copies are part of the time.
+static void benchGravity(int size)
+{
+    std::vector<uint8_t> start(size * size), startMatched(size * size, 0);
+    std::vector<uint8_t> cells(size * size), matched(size * size);
+    Rng rng(size);
+    randomBoard(start, rng);
+    markMatches(&start[0], &startMatched[0], size, size);
+
+    measure("gravity", std::to_string(size), size, size, size * size, [&](int reps) {
+        for (int r = 0; r < reps; r++)
+        {
+            memcpy(&cells[0], &start[0], cells.size());
+            memcpy(&matched[0], &startMatched[0], matched.size());
+            collapseMatches(&cells[0], &matched[0], size, size, rng);
+        }
+        gSink += cells[0];
+    }, [&] {
+        bool ok = std::count(matched.begin(), matched.end(), 0) == (long) matched.size();
+        for (size_t i = 0; i < cells.size(); i++)
+            ok = ok && cells[i] < NUM_COLORS;
+        return ok;
+    });
+}
+
+// A single click on the bottom row, which moves the whole column.
+static void benchPop(int size)
+{
+    std::vector<uint8_t> cells(size * size);
+    Rng rng(size);
+    randomBoard(cells, rng);
+
+    measure("pop", std::to_string(size), size, size, size, [&](int reps) {
+        for (int r = 0; r < reps; r++)
+            popTile(&cells[0], size, size - 1, r % size, rng);
+        gSink += cells[0];
+    }, [] { return true; });
+}
+
+// The per-tile modeling matrices drawTile builds every frame.
+static void benchTransform(int size)
+{
+    BoardFrame frame;
+    frame.rows = frame.cols = size;
+    frame.angle = 30;
+    frame.tiles.resize(size * size);
+    for (int i = 0; i < size * size; i++)
+    {
+        frame.tiles[i].colorId = i % NUM_COLORS;
+        frame.tiles[i].row = i / size;
+        frame.tiles[i].scale = 1;
+    }
+
+    measure("transform", std::to_string(size), size, size, size * size, [&](int reps) {
+        glm::mat4 modelMat, modelMatInvTr;
+        for (int r = 0; r < reps; r++)
+        {
+            for (int i = 0; i < size * size; i++)
+                tileTransform(frame, i % size, frame.tiles[i], modelMat, modelMatInvTr);
+            gSink += (uint64_t) modelMatInvTr[3][3];
+        }
+    }, [] { return true; });
+}
+
+static void benchParse(const std::string& fileName, const std::string& label)
+{
+    ObjData data;
+    if (!parseObj(fileName, data))
+    {
+        fprintf(stderr, "Cannot open %s\n", fileName.c_str());
+        return;
+    }
+    size_t triangles = data.indices.size() / 3;
+    data.release();
+
+    measure("parse", label, 0, 0, triangles, [&](int reps) {
+        for (int r = 0; r < reps; r++)
+        {
+            parseObj(fileName, data);
+            gSink += data.indices.size();
+            data.release();
+        }
+    }, [&] { return triangles > 0; });
+}
+
+// A UV sphere for when no real mesh is given, with "f v//n" faces or, if
+// `normals` is false, plain "f v" faces whose normals the loader computes.
+static std::string writeSphere(int rings, int segments, bool normals)
+{
+    char name[] = "/tmp/bench_sphereXXXXXX";
+    int fd = mkstemp(name);
+    FILE* file = fd >= 0 ? fdopen(fd, "w") : NULL;
+    if (!file)
+        return "";
+
+    for (int r = 0; r <= rings; r++)
+    {
+        float theta = 3.14159265f * r / rings;
+        for (int s = 0; s < segments; s++)
+        {
+            float phi = 6.2831853f * s / segments;
+            float x = sinf(theta) * cosf(phi), y = cosf(theta), z = sinf(theta) * sinf(phi);
+            fprintf(file, "v %f %f %f\n", x, y, z);
+            if (normals)
+                fprintf(file, "vn %f %f %f\n", x, y, z);
+        }
+    }
+    for (int r = 0; r < rings; r++)
+    {
+        for (int s = 0; s < segments; s++)
+        {
+            int a = r * segments + s + 1, b = r * segments + (s + 1) % segments + 1;
+            int c = a + segments, d = b + segments;
+            if (normals)
+            {
+                fprintf(file, "f %d//%d %d//%d %d//%d\n", a, a, c, c, b, b);
+                fprintf(file, "f %d//%d %d//%d %d//%d\n", b, b, c, c, d, d);
+            }
+            else
+            {
+                fprintf(file, "f %d %d %d\nf %d %d %d\n", a, c, b, b, c, d);
+            }
+        }
+    }
+    fclose(file);
+    return name;
+}
+
+static bool runCase(const std::vector<std::string>& cases, const char* name)
+{
+    return cases.empty() || std::find(cases.begin(), cases.end(), name) != cases.end();
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<std::string> cases, meshes;
+    std::vector<int> sizes = {8, 9, 10, 16, 64, 256, 1024, 4096};
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--case" && i + 1 < argc)
+            cases.push_back(argv[++i]);
+        else if (arg == "--mesh" && i + 1 < argc)
+            meshes.push_back(argv[++i]);
+        else if (arg == "--runs" && i + 1 < argc)
+            gRuns = std::max(1, atoi(argv[++i]));
+        else if (arg == "--generic")
+            useFixedKernels(false);
+        else if (arg == "--sizes" && i + 1 < argc)
+        {
+            sizes.clear();
+            for (char* p = strtok(argv[++i], ","); p; p = strtok(NULL, ","))
+                sizes.push_back(atoi(p));
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [--case <name>] [--sizes 8,9,10] [--mesh file.obj] [--runs n] [--generic]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    printf("case,build,kernel,param,rows,cols,items,reps,ms_min,ms_median,ns_per_item,check\n");
+
+    for (size_t i = 0; i < sizes.size(); i++)
+    {
+        int size = sizes[i];
+        if (size < 1)
+            continue;
+        if (runCase(cases, "generate"))
+            benchGenerate(size);
+        if (runCase(cases, "match"))
+            benchMatch(size);
+        if (runCase(cases, "match_stable"))
+            benchMatchStable(size);
+        if (runCase(cases, "gravity"))
+            benchGravity(size);
+        if (runCase(cases, "pop"))
+            benchPop(size);
+        if (runCase(cases, "transform") && size <= 1024) // larger boards are never drawn
+            benchTransform(size);
+    }
+
+    if (runCase(cases, "parse"))
+    {
+        if (meshes.empty())
+        {
+            std::string sphere = writeSphere(256, 256, true);
+            std::string bare = writeSphere(256, 256, false);
+            benchParse(sphere, "sphere");
+            benchParse(bare, "sphere-no-normals");
+            unlink(sphere.c_str());
+            unlink(bare.c_str());
+        }
+        for (size_t i = 0; i < meshes.size(); i++)
+            benchParse(meshes[i], meshes[i]);
+    }
+
+    return 0;
+}
@@ -0,0 +1,460 @@
+#include <utility>
+#include "board.h"
+#include "trace.h"
+
+// Color of (row - 1, col) dropped into (row, col) lines up with two of
+// its new horizontal neighbors.
+static bool dropMakesRow(const uint8_t* cells, int cols, int row, int col)
+{
+    const uint8_t* r = cells + row * cols;
+    uint8_t c = cells[(row - 1) * cols + col];
+
+    bool l1 = col >= 1 && r[col - 1] == c;
+    bool l2 = col >= 2 && r[col - 2] == c;
+    bool r1 = col + 1 < cols && r[col + 1] == c;
+    bool r2 = col + 2 < cols && r[col + 2] == c;
+
+    return (l1 && l2) || (l1 && r1) || (r1 && r2);
+}
+
+// Clicking (row, col) closes the gap between (row - 1) and (row + 1) in
+// that column; check the vertical runs across the seam.
+static bool seamMakesColumn(const uint8_t* cells, int rows, int cols, int row, int col)
+{
+    const uint8_t* c = cells + col;
+    if (row >= 2 && row + 1 < rows &&
+        c[(row - 2) * cols] == c[(row - 1) * cols] && c[(row - 1) * cols] == c[(row + 1) * cols])
+        return true;
+    if (row >= 1 && row + 2 < rows &&
+        c[(row - 1) * cols] == c[(row + 1) * cols] && c[(row + 1) * cols] == c[(row + 2) * cols])
+        return true;
+    return false;
+}
+
+// Fixed-size kernels. Most games are played on 8x8, 9x9 or 10x10 boards.
+// With the dimensions as template parameters every loop below has constant
+// bounds and the bounds checks of the generic code fold away, so the
+// compiler unrolls the scans and vectorizes the branch-free run check.
+// They give exactly the results of the generic versions, including the
+// order in which refills are drawn.
+
+static bool gFixedKernels = true;
+
+// Size of the specialization for a rows x cols board, 0 for the generic code
+static int fixedSize(int rows, int cols)
+{
+    if (!gFixedKernels || rows != cols)
+        return 0;
+    return rows >= 8 && rows <= 10 ? rows : 0;
+}
+
+// Branch-free over the whole board, so it vectorizes. Most scans during
+// play find nothing, and then this is all the work markMatches does.
+template <int ROWS, int COLS>
+static bool hasRunFixed(const uint8_t* cells)
+{
+    unsigned run = 0;
+    for (int i = 0; i < ROWS; i++)
+    {
+        const uint8_t* r = cells + i * COLS;
+        for (int j = 0; j + 2 < COLS; j++)
+            run |= (r[j] == r[j + 1]) & (r[j + 1] == r[j + 2]);
+    }
+    for (int i = 0; i + 2 < ROWS; i++)
+    {
+        const uint8_t* r = cells + i * COLS;
+        for (int j = 0; j < COLS; j++)
+            run |= (r[j] == r[j + COLS]) & (r[j + COLS] == r[j + 2 * COLS]);
+    }
+    return run != 0;
+}
+
+// markMatches() with constant dimensions; the same scan in the same order.
+template <int ROWS, int COLS>
+static int markMatchesFixed(const uint8_t* cells, uint8_t* matched)
+{
+    if (!hasRunFixed<ROWS, COLS>(cells))
+        return 0;
+
+    int score = 0;
+#pragma GCC unroll 16
+    for (int i = 0; i < ROWS; i++)
+    {
+#pragma GCC unroll 16
+        for (int j = 0; j < COLS; j++)
+        {
+            if (matched[i * COLS + j])
+                continue;
+
+            uint8_t c = cells[i * COLS + j];
+            if (i < ROWS - 2 && cells[(i + 1) * COLS + j] == c && cells[(i + 2) * COLS + j] == c)
+            {
+                int a = 3;
+                while (i + a < ROWS && cells[(i + a) * COLS + j] == c)
+                    a++;
+                for (int x = i; x < i + a; x++)
+                    matched[x * COLS + j] = 1;
+                score += a;
+            }
+            if (j < COLS - 2 && cells[i * COLS + j + 1] == c && cells[i * COLS + j + 2] == c)
+            {
+                int b = 3;
+                while (j + b < COLS && cells[i * COLS + j + b] == c)
+                    b++;
+                for (int x = j; x < j + b; x++)
+                    matched[i * COLS + x] = 1;
+                score += b;
+            }
+        }
+    }
+    return score;
+}
+
+// collapseColumn() with constant dimensions
+template <int ROWS, int COLS>
+static int collapseColumnFixed(uint8_t* cells, uint8_t* matched, int col, Rng& rng)
+{
+    uint8_t* c = cells + col;
+    uint8_t* m = matched + col;
+
+    int dst = ROWS - 1;
+#pragma GCC unroll 16
+    for (int i = ROWS - 1; i >= 0; i--)
+    {
+        // branch-free compaction: every tile is written, only survivors advance
+        uint8_t gone = m[i * COLS];
+        c[dst * COLS] = c[i * COLS];
+        m[i * COLS] = 0;
+        dst -= !gone;
+    }
+    int removed = dst + 1;
+    for (; dst >= 0; dst--)
+        c[dst * COLS] = rng.below(NUM_COLORS);
+    return removed;
+}
+
+template <int ROWS, int COLS>
+static void collapseMatchesFixed(uint8_t* cells, uint8_t* matched, Rng& rng)
+{
+    for (int j = 0; j < COLS; j++)
+    {
+        // most columns of a cascade lose nothing
+        bool any = false;
+#pragma GCC unroll 16
+        for (int i = 0; i < ROWS; i++)
+            any |= matched[i * COLS + j] != 0;
+        if (any)
+            collapseColumnFixed<ROWS, COLS>(cells, matched, j, rng);
+    }
+}
+
+void useFixedKernels(bool enabled)
+{
+    gFixedKernels = enabled;
+}
+
+const char* boardKernelName(int rows, int cols)
+{
+    switch (fixedSize(rows, cols))
+    {
+    case 8: return "fixed 8x8";
+    case 9: return "fixed 9x9";
+    case 10: return "fixed 10x10";
+    }
+    return "generic";
+}
+
+void generateBoard(uint8_t* cells, int rows, int cols, Rng& rng)
+{
+    // Plant one productive move: (wr, wc - 2), (wr, wc - 1) and (wr - 1, wc)
+    // share a color, so clicking (wr, wc) completes the row. The handful of
+    // cells that could otherwise turn the planted cells into a run are kept
+    // off that color.
+    int wr = -10, wc = -10;
+    int wcolor = 0;
+    if (rows >= 2 && cols >= 3)
+    {
+        wr = 1 + rng.below(rows - 1);
+        wc = 2 + rng.below(cols - 2);
+        wcolor = rng.below(NUM_COLORS);
+    }
+
+    for (int i = 0; i < rows; i++)
+    {
+        uint8_t* row = cells + i * cols;
+        const uint8_t* up1 = row - cols;
+        const uint8_t* up2 = row - 2 * cols;
+        bool nearWitness = i >= wr - 2 && i <= wr;
+
+        for (int j = 0; j < cols; j++)
+        {
+            unsigned forbidden = 0;
+            if (j >= 2 && row[j - 1] == row[j - 2])
+                forbidden |= 1u << row[j - 1];
+            if (i >= 2 && up1[j] == up2[j])
+                forbidden |= 1u << up1[j];
+
+            if (nearWitness)
+            {
+                if ((i == wr && (j == wc - 2 || j == wc - 1)) || (i == wr - 1 && j == wc))
+                {
+                    row[j] = wcolor;
+                    continue;
+                }
+                if ((i == wr - 1 && (j == wc - 2 || j == wc - 1)) || (i == wr - 2 && j == wc) || (i == wr && j == wc - 3))
+                    forbidden |= 1u << wcolor;
+            }
+
+            // pick uniformly among the allowed colors
+            unsigned allowed = ~forbidden & ((1u << NUM_COLORS) - 1);
+            int k = rng.below(__builtin_popcount(allowed));
+            while (k--)
+                allowed &= allowed - 1;
+            row[j] = __builtin_ctz(allowed);
+        }
+    }
+}
+
+bool boardHasMatch(const uint8_t* cells, int rows, int cols)
+{
+    switch (fixedSize(rows, cols))
+    {
+    case 8: return hasRunFixed<8, 8>(cells);
+    case 9: return hasRunFixed<9, 9>(cells);
+    case 10: return hasRunFixed<10, 10>(cells);
+    }
+
+    for (int i = 0; i < rows; i++)
+    {
+        for (int j = 0; j < cols; j++)
+        {
+            uint8_t c = cells[i * cols + j];
+            if (j + 2 < cols && cells[i * cols + j + 1] == c && cells[i * cols + j + 2] == c)
+                return true;
+            if (i + 2 < rows && cells[(i + 1) * cols + j] == c && cells[(i + 2) * cols + j] == c)
+                return true;
+        }
+    }
+    return false;
+}
+
+bool isProductiveMove(const uint8_t* cells, int rows, int cols, int row, int col)
+{
+    if (seamMakesColumn(cells, rows, cols, row, col))
+        return true;
+    for (int r = 1; r <= row; r++)
+    {
+        if (dropMakesRow(cells, cols, r, col))
+            return true;
+    }
+    return false;
+}
+
+bool boardHasMove(const uint8_t* cells, int rows, int cols)
+{
+    for (int i = 0; i < rows; i++)
+    {
+        for (int j = 0; j < cols; j++)
+        {
+            if (i >= 1 && dropMakesRow(cells, cols, i, j))
+                return true;
+            if (seamMakesColumn(cells, rows, cols, i, j))
+                return true;
+        }
+    }
+    return false;
+}
+
+int markMatches(const uint8_t* cells, uint8_t* matched, int rows, int cols)
+{
+    TRACE_ZONE("markMatches");
+    switch (fixedSize(rows, cols))
+    {
+    case 8: return markMatchesFixed<8, 8>(cells, matched);
+    case 9: return markMatchesFixed<9, 9>(cells, matched);
+    case 10: return markMatchesFixed<10, 10>(cells, matched);
+    }
+
+    int score = 0;
+    for (int i = 0; i < rows; i++)
+    {
+        for (int j = 0; j < cols; j++)
+        {
+            if (matched[i * cols + j])
+                continue;
+
+            uint8_t c = cells[i * cols + j];
+            if (i < rows - 2 && cells[(i + 1) * cols + j] == c && cells[(i + 2) * cols + j] == c)
+            {
+                int a = 3;
+                while (i + a < rows && cells[(i + a) * cols + j] == c)
+                    a++;
+                for (int x = i; x < i + a; x++)
+                    matched[x * cols + j] = 1;
+                score += a;
+            }
+            if (j < cols - 2 && cells[i * cols + j + 1] == c && cells[i * cols + j + 2] == c)
+            {
+                int b = 3;
+                while (j + b < cols && cells[i * cols + j + b] == c)
+                    b++;
+                for (int x = j; x < j + b; x++)
+                    matched[i * cols + x] = 1;
+                score += b;
+            }
+        }
+    }
+    return score;
+}
+
+int collapseColumn(uint8_t* cells, uint8_t* matched, int rows, int cols, int col, Rng& rng)
+{
+    switch (fixedSize(rows, cols))
+    {
+    case 8: return collapseColumnFixed<8, 8>(cells, matched, col, rng);
+    case 9: return collapseColumnFixed<9, 9>(cells, matched, col, rng);
+    case 10: return collapseColumnFixed<10, 10>(cells, matched, col, rng);
+    }
+
+    // compact the surviving tiles to the bottom of the column
+    int dst = rows - 1;
+    for (int i = rows - 1; i >= 0; i--)
+    {
+        if (matched[i * cols + col])
+        {
+            matched[i * cols + col] = 0;
+            continue;
+        }
+        cells[dst * cols + col] = cells[i * cols + col];
+        dst--;
+    }
+    int removed = dst + 1;
+    for (; dst >= 0; dst--)
+        cells[dst * cols + col] = rng.below(NUM_COLORS);
+    return removed;
+}
+
+void collapseMatches(uint8_t* cells, uint8_t* matched, int rows, int cols, Rng& rng)
+{
+    TRACE_ZONE("collapseMatches");
+    switch (fixedSize(rows, cols))
+    {
+    case 8: return collapseMatchesFixed<8, 8>(cells, matched, rng);
+    case 9: return collapseMatchesFixed<9, 9>(cells, matched, rng);
+    case 10: return collapseMatchesFixed<10, 10>(cells, matched, rng);
+    }
+
+    for (int j = 0; j < cols; j++)
+        collapseColumn(cells, matched, rows, cols, j, rng);
+}
+
+void popTile(uint8_t* cells, int cols, int row, int col, Rng& rng)
+{
+    for (int i = row; i > 0; i--)
+        cells[i * cols + col] = cells[(i - 1) * cols + col];
+    cells[col] = rng.below(NUM_COLORS);
+}
+
+MoveResult playMove(uint8_t* cells, uint8_t* matched, int rows, int cols, int row, int col, Rng& rng)
+{
+    MoveResult result = {0, 0};
+    popTile(cells, cols, row, col, rng);
+
+    int score;
+    while ((score = markMatches(cells, matched, rows, cols)) > 0)
+    {
+        result.score += score;
+        result.cascades++;
+        collapseMatches(cells, matched, rows, cols, rng);
+    }
+    return result;
+}
+
+// Placing color c at (row, col) completes a run with the cells to its
+// left or above it.
+static bool makesRun(const uint8_t* cells, int cols, int row, int col, uint8_t c)
+{
+    if (col >= 2 && cells[row * cols + col - 1] == c && cells[row * cols + col - 2] == c)
+        return true;
+    if (row >= 2 && cells[(row - 1) * cols + col] == c && cells[(row - 2) * cols + col] == c)
+        return true;
+    return false;
+}
+
+bool shuffleBoard(uint8_t* cells, int rows, int cols, Rng& rng)
+{
+    int n = rows * cols;
+
+    for (int attempt = 0; attempt < 64; attempt++)
+    {
+        for (int k = n - 1; k > 0; k--)
+            std::swap(cells[k], cells[rng.below(k + 1)]);
+
+        // fix runs left to right by swapping in a later tile that fits
+        bool ok = true;
+        for (int k = 0; k < n && ok; k++)
+        {
+            int i = k / cols, j = k % cols;
+            if (!makesRun(cells, cols, i, j, cells[k]))
+                continue;
+
+            int m = n - k - 1;
+            int start = m > 0 ? rng.below(m) : 0;
+            ok = false;
+            for (int t = 0; t < m; t++)
+            {
+                int idx = k + 1 + (start + t) % m;
+                if (!makesRun(cells, cols, i, j, cells[idx]))
+                {
+                    std::swap(cells[k], cells[idx]);
+                    ok = true;
+                    break;
+                }
+            }
+        }
+
+        if (ok && boardHasMove(cells, rows, cols))
+            return true;
+    }
+    return false;
+}
+
+void MoveIndex::build(const uint8_t* cells, int rows, int cols)
+{
+    mRows = rows;
+    mCols = cols;
+    mCount = 0;
+    mBits.assign(rows * cols, 0);
+
+    for (int i = 0; i < rows; i++)
+        for (int j = 0; j < cols; j++)
+            update(cells, i, j);
+}
+
+void MoveIndex::update(const uint8_t* cells, int row, int col)
+{
+    uint8_t bits = 0;
+    if (row >= 1 && dropMakesRow(cells, mCols, row, col))
+        bits |= 1;
+    if (seamMakesColumn(cells, mRows, mCols, row, col))
+        bits |= 2;
+
+    uint8_t& old = mBits[row * mCols + col];
+    mCount += __builtin_popcount(bits) - __builtin_popcount(old);
+    old = bits;
+}
+
+void MoveIndex::cellChanged(const uint8_t* cells, int row, int col)
+{
+    // drop witnesses read the tile above and the two tiles on each side
+    if (row + 1 < mRows)
+        update(cells, row + 1, col);
+    for (int j = col - 2; j <= col + 2; j++)
+        if (j >= 0 && j < mCols)
+            update(cells, row, j);
+
+    // seam witnesses read two tiles above and below in their column
+    for (int i = row - 2; i <= row + 2; i++)
+        if (i >= 0 && i < mRows && i != row)
+            update(cells, i, col);
+}
@@ -0,0 +1,138 @@
+#ifndef BOARD_H
+#define BOARD_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Board rules that do not depend on OpenGL.
+//
+// A board is a row-major array of color ids, row 0 at the top. A move
+// clicks one tile: it pops, the tiles above it in the same column drop by
+// one and a new random tile enters at the top. A move is *productive* when
+// it creates a run of three or more no matter which color enters at the
+// top.
+
+const int NUM_COLORS = 5;
+
+/// xorshift64* generator. The whole state is one word, so it can be seeded
+/// per board and saved along with it.
+struct Rng
+{
+    explicit Rng(uint64_t seed = 1) { this->seed(seed); }
+
+    void seed(uint64_t s)
+    {
+        state = s ^ 0x9E3779B97F4A7C15ull;
+        if (state == 0)
+            state = 1;
+        next();
+    }
+
+    uint32_t next()
+    {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return (state * 2685821657736338717ull) >> 32;
+    }
+
+    /// Uniform integer in [0, n)
+    int below(int n) { return (int) (((uint64_t) next() * n) >> 32); }
+
+    uint64_t state;
+};
+
+/// Fills a rows x cols board in one pass so that it contains no run of
+/// three and, when the board is at least 2x3, at least one productive move.
+/// Each cell picks among the colors not forbidden by its two left and two
+/// upper neighbors.
+void generateBoard(uint8_t* cells, int rows, int cols, Rng& rng);
+
+/// True if the board contains a horizontal or vertical run of three.
+bool boardHasMatch(const uint8_t* cells, int rows, int cols);
+
+/// True if clicking (row, col) is a productive move.
+bool isProductiveMove(const uint8_t* cells, int rows, int cols, int row, int col);
+
+/// True if any productive move exists (full scan).
+bool boardHasMove(const uint8_t* cells, int rows, int cols);
+
+/// Permutes the tiles in place into an arrangement without runs of three
+/// that has at least one productive move. Returns false (leaving some
+/// permutation of the tiles) if no such arrangement was found, e.g. when
+/// one color dominates the board.
+bool shuffleBoard(uint8_t* cells, int rows, int cols, Rng& rng);
+
+/// Marks every run of three or more in `matched` (one byte per cell,
+/// expected zeroed) and returns the score it is worth. Follows the game's
+/// matchAndPop: a tile that starts both a vertical and a horizontal run
+/// counts for both.
+int markMatches(const uint8_t* cells, uint8_t* matched, int rows, int cols);
+
+/// Removes the marked tiles, lets the tiles above them fall and fills the
+/// gaps at the top of each column with new tiles. Clears `matched`.
+void collapseMatches(uint8_t* cells, uint8_t* matched, int rows, int cols, Rng& rng);
+
+/// collapseMatches() for column `col` only. Returns the tiles removed.
+int collapseColumn(uint8_t* cells, uint8_t* matched, int rows, int cols, int col, Rng& rng);
+
+/// Pops the tile at (row, col): the tiles above it drop by one and a new
+/// tile enters at the top of the column.
+void popTile(uint8_t* cells, int cols, int row, int col, Rng& rng);
+
+/// Whether the rules above use the kernels specialized for 8x8, 9x9 and
+/// 10x10 boards when a board has one of those sizes (the default). They
+/// give the same results as the generic code; turning them off is for
+/// comparing the two.
+void useFixedKernels(bool enabled);
+
+/// Which kernels a rows x cols board uses, e.g. "fixed 8x8" or "generic".
+const char* boardKernelName(int rows, int cols);
+
+struct MoveResult
+{
+    int score;    // tiles matched, counted like numOfMatched
+    int cascades; // match rounds until the board was stable
+};
+
+/// Plays one click: popTile, then markMatches/collapseMatches until no run
+/// is left. `matched` is rows * cols bytes of zeroed scratch space.
+MoveResult playMove(uint8_t* cells, uint8_t* matched, int rows, int cols, int row, int col, Rng& rng);
+
+/// Counts the witnesses for productive moves and keeps the count up to
+/// date as single cells change, so "is any move left?" is O(1).
+///
+/// A witness is either a tile that would complete a row if the tile above
+/// it dropped into its place, or a click that would close a vertical run
+/// across the gap it leaves. A board has a productive move iff it has at
+/// least one witness.
+class MoveIndex
+{
+public:
+    MoveIndex() : mRows(0), mCols(0), mCount(0) { }
+
+    void build(const uint8_t* cells, int rows, int cols);
+
+    /// Call after cells[row * cols + col] changed. Rechecks only the
+    /// witnesses that read that cell.
+    void cellChanged(const uint8_t* cells, int row, int col);
+
+    bool anyMove() const { return mCount > 0; }
+    int witnesses() const { return mCount; }
+
+    /// True if clicking (row, col) is known to be productive. Every
+    /// witness is itself such a click.
+    bool isWitness(int row, int col) const { return mBits[row * mCols + col] != 0; }
+
+    size_t memoryUsage() const { return mBits.capacity(); }
+
+private:
+    void update(const uint8_t* cells, int row, int col);
+
+    int mRows, mCols;
+    int mCount;
+    std::vector<uint8_t> mBits; // per cell: 1 = drop witness, 2 = seam witness
+};
+
+#endif
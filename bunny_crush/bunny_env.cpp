@@ -0,0 +1,197 @@
+#include <new>
+#include <vector>
+#include "board.h"
+#include "bunny_env.h"
+
+static_assert(BUNNY_NUM_COLORS == NUM_COLORS, "bunny_env.h is out of date");
+
+// Every array is indexed by board and sized once at creation, so the
+// pointers handed out stay valid for the life of the env.
+struct BunnyEnv
+{
+    int rows, cols, count, maxMoves;
+    std::vector<uint8_t> cells;
+    std::vector<uint8_t> matched; // playMove() scratch, one board
+    std::vector<Rng> rngs;
+    std::vector<int32_t> rewards, moves, scores;
+    std::vector<uint8_t> dones;
+
+    uint8_t* board(int i) { return &cells[(size_t) i * rows * cols]; }
+};
+
+static void newGame(BunnyEnv* env, int i)
+{
+    generateBoard(env->board(i), env->rows, env->cols, env->rngs[i]);
+    env->rewards[i] = 0;
+    env->moves[i] = 0;
+    env->scores[i] = 0;
+    // only boards of at least 2x3 get a planted move; narrower ones can be
+    // dealt dead, and boards with neither three columns nor four rows
+    // never have a move
+    env->dones[i] = !boardHasMove(env->board(i), env->rows, env->cols);
+}
+
+static int play(BunnyEnv* env, int i, int action)
+{
+    int size = env->rows * env->cols;
+    if (env->dones[i] || action < 0 || action >= size)
+        return -1;
+
+    uint8_t* cells = env->board(i);
+    MoveResult result = playMove(cells, &env->matched[0], env->rows, env->cols, action / env->cols,
+                                 action % env->cols, env->rngs[i]);
+    env->moves[i]++;
+    env->scores[i] += result.score;
+    env->dones[i] = (env->maxMoves > 0 && env->moves[i] >= env->maxMoves) ||
+                    !boardHasMove(cells, env->rows, env->cols);
+    return result.score;
+}
+
+int bunny_api_version(void)
+{
+    return BUNNY_API_VERSION;
+}
+
+BunnyEnv* bunny_env_create(int rows, int cols, int count, int max_moves, uint64_t seed)
+{
+    if (rows <= 0 || cols <= 0 || count <= 0 || (int64_t) rows * cols > (1 << 30) / count)
+        return NULL;
+
+    BunnyEnv* env = new (std::nothrow) BunnyEnv;
+    if (!env)
+        return NULL;
+    try
+    {
+        env->rows = rows;
+        env->cols = cols;
+        env->count = count;
+        env->maxMoves = max_moves;
+        env->cells.resize((size_t) count * rows * cols);
+        env->matched.assign(rows * cols, 0);
+        env->rngs.resize(count);
+        env->rewards.resize(count);
+        env->moves.resize(count);
+        env->scores.resize(count);
+        env->dones.resize(count);
+    }
+    catch (const std::bad_alloc&)
+    {
+        delete env;
+        return NULL;
+    }
+
+    bunny_env_seed(env, seed);
+    return env;
+}
+
+void bunny_env_destroy(BunnyEnv* env)
+{
+    delete env;
+}
+
+int bunny_env_rows(const BunnyEnv* env)
+{
+    return env->rows;
+}
+
+int bunny_env_cols(const BunnyEnv* env)
+{
+    return env->cols;
+}
+
+int bunny_env_count(const BunnyEnv* env)
+{
+    return env->count;
+}
+
+void bunny_env_seed(BunnyEnv* env, uint64_t seed)
+{
+    // the same per-game seeds as batchsim
+    for (int i = 0; i < env->count; i++)
+    {
+        env->rngs[i].seed(seed * 0x9E3779B97F4A7C15ull + i);
+        newGame(env, i);
+    }
+}
+
+void bunny_env_reset(BunnyEnv* env, int index)
+{
+    if (index >= 0 && index < env->count)
+        newGame(env, index);
+}
+
+int bunny_env_reset_done(BunnyEnv* env)
+{
+    int reset = 0;
+    for (int i = 0; i < env->count; i++)
+    {
+        if (env->dones[i])
+        {
+            newGame(env, i);
+            reset++;
+        }
+    }
+    return reset;
+}
+
+int bunny_env_step(BunnyEnv* env, int index, int action)
+{
+    if (index < 0 || index >= env->count)
+        return -1;
+    int reward = play(env, index, action);
+    env->rewards[index] = reward < 0 ? 0 : reward;
+    return reward;
+}
+
+void bunny_env_step_batch(BunnyEnv* env, const int32_t* actions)
+{
+    for (int i = 0; i < env->count; i++)
+    {
+        int reward = play(env, i, actions[i]);
+        env->rewards[i] = reward < 0 ? 0 : reward;
+    }
+}
+
+uint8_t* bunny_env_cells(BunnyEnv* env)
+{
+    return &env->cells[0];
+}
+
+const int32_t* bunny_env_rewards(const BunnyEnv* env)
+{
+    return &env->rewards[0];
+}
+
+const uint8_t* bunny_env_dones(const BunnyEnv* env)
+{
+    return &env->dones[0];
+}
+
+const int32_t* bunny_env_moves(const BunnyEnv* env)
+{
+    return &env->moves[0];
+}
+
+const int32_t* bunny_env_scores(const BunnyEnv* env)
+{
+    return &env->scores[0];
+}
+
+int bunny_env_productive_moves(const BunnyEnv* env, int index, uint8_t* mask)
+{
+    if (index < 0 || index >= env->count)
+        return 0;
+
+    const uint8_t* cells = &env->cells[(size_t) index * env->rows * env->cols];
+    int productive = 0;
+    for (int i = 0; i < env->rows; i++)
+    {
+        for (int j = 0; j < env->cols; j++)
+        {
+            uint8_t p = isProductiveMove(cells, env->rows, env->cols, i, j);
+            mask[i * env->cols + j] = p;
+            productive += p;
+        }
+    }
+    return productive;
+}
@@ -0,0 +1,95 @@
+#ifndef BUNNY_ENV_H
+#define BUNNY_ENV_H
+
+#include <stdint.h>
+
+/* C API for playing the game without a window, e.g. to train agents.
+ *
+ * A BunnyEnv is a batch of `count` boards of the same size, played with
+ * the rules in board.h: a move clicks one tile, which pops, and the board
+ * then cascades until no run of three is left. The whole cascade happens
+ * inside one step, so there is no animation.
+ *
+ * Board state lives in buffers owned by the env that the caller reads in
+ * place. Cells are one color id (0 to BUNNY_NUM_COLORS - 1) per byte,
+ * row-major, row 0 at the top, and board i starts at i * rows * cols. From
+ * Python, wrap them with numpy.ctypeslib.as_array and no copies are made.
+ * The pointers stay valid until bunny_env_destroy(). Cells may be written
+ * to set up a position; done flags only change on steps and resets.
+ *
+ * A board is done when no productive move is left or after max_moves
+ * moves. Stepping a done board does nothing until it is reset.
+ *
+ * Envs share no state, so different envs may be used from different
+ * threads; a single env must not be used by two threads at once.
+ *
+ * Build with `make libbunny`, which produces libbunny.so. */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BUNNY_API_VERSION 1
+#define BUNNY_NUM_COLORS 5
+
+#if defined(__GNUC__)
+#define BUNNY_API __attribute__((visibility("default")))
+#else
+#define BUNNY_API
+#endif
+
+typedef struct BunnyEnv BunnyEnv;
+
+/* Returns BUNNY_API_VERSION of the library, to check against the header. */
+BUNNY_API int bunny_api_version(void);
+
+/* Creates `count` boards, each seeded from `seed` and its index. Returns
+ * NULL if a size is not positive or out of memory. max_moves <= 0 means
+ * no move limit. */
+BUNNY_API BunnyEnv* bunny_env_create(int rows, int cols, int count, int max_moves, uint64_t seed);
+BUNNY_API void bunny_env_destroy(BunnyEnv* env);
+
+BUNNY_API int bunny_env_rows(const BunnyEnv* env);
+BUNNY_API int bunny_env_cols(const BunnyEnv* env);
+BUNNY_API int bunny_env_count(const BunnyEnv* env);
+
+/* Reseeds and resets every board. Board i plays the same game as board i
+ * of any env created or seeded with the same seed. */
+BUNNY_API void bunny_env_seed(BunnyEnv* env, uint64_t seed);
+
+/* Starts a new game on board `index`, continuing its generator. */
+BUNNY_API void bunny_env_reset(BunnyEnv* env, int index);
+
+/* Resets every done board. Returns how many were reset. */
+BUNNY_API int bunny_env_reset_done(BunnyEnv* env);
+
+/* Clicks cell `action` (row * cols + col) on board `index` and returns the
+ * reward: the tiles matched by the move and its cascades, counted like the
+ * game's score. Returns -1 without changing anything if the board is done
+ * or the action is out of range. */
+BUNNY_API int bunny_env_step(BunnyEnv* env, int index, int action);
+
+/* Steps every board in one call. actions[i] is the move for board i; a
+ * negative action, or a done board, skips it and its reward is 0. Rewards
+ * and done flags are then in bunny_env_rewards() and bunny_env_dones(). */
+BUNNY_API void bunny_env_step_batch(BunnyEnv* env, const int32_t* actions);
+
+/* count * rows * cols bytes, see above */
+BUNNY_API uint8_t* bunny_env_cells(BunnyEnv* env);
+
+/* One entry per board: the reward of the last step, the done flag, and
+ * the moves and total score of the current game. */
+BUNNY_API const int32_t* bunny_env_rewards(const BunnyEnv* env);
+BUNNY_API const uint8_t* bunny_env_dones(const BunnyEnv* env);
+BUNNY_API const int32_t* bunny_env_moves(const BunnyEnv* env);
+BUNNY_API const int32_t* bunny_env_scores(const BunnyEnv* env);
+
+/* Writes rows * cols bytes to `mask`: 1 for every productive move on board
+ * `index`, 0 otherwise. Returns the number of productive moves. */
+BUNNY_API int bunny_env_productive_moves(const BunnyEnv* env, int index, uint8_t* mask);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
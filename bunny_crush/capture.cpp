@@ -0,0 +1,356 @@
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include "capture.h"
+
+static bool endsWith(const std::string& s, const char* suffix)
+{
+    size_t n = strlen(suffix);
+    return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+CaptureFormat captureFormatFor(const std::string& fileName)
+{
+    if (endsWith(fileName, ".y4m"))
+        return CAPTURE_Y4M;
+    if (endsWith(fileName, ".png"))
+        return CAPTURE_PNG;
+    return CAPTURE_RAW;
+}
+
+// PNG without zlib: the image data goes into stored (uncompressed) deflate
+// blocks, which only need the CRC and Adler checksums. The files are large
+// but cost almost nothing to write; recompress them offline if needed.
+
+static uint32_t gCrcTable[256];
+
+static void initCrcTable()
+{
+    for (uint32_t n = 0; n < 256; n++)
+    {
+        uint32_t c = n;
+        for (int k = 0; k < 8; k++)
+            c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+        gCrcTable[n] = c;
+    }
+}
+
+static uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc = 0)
+{
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++)
+        crc = gCrcTable[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+static void putBE32(std::vector<uint8_t>& out, uint32_t v)
+{
+    out.push_back(v >> 24);
+    out.push_back(v >> 16);
+    out.push_back(v >> 8);
+    out.push_back(v);
+}
+
+static void putChunk(std::vector<uint8_t>& out, const char* type, const uint8_t* data, size_t size)
+{
+    putBE32(out, size);
+    size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data, data + size);
+    putBE32(out, crc32(&out[start], out.size() - start));
+}
+
+// Flips the bottom-up RGBA rows into top-down RGB, each row preceded by a
+// PNG filter byte if `filterByte` is set.
+static void toRgbRows(const uint8_t* rgba, int width, int height, bool filterByte, uint8_t* out)
+{
+    for (int y = height - 1; y >= 0; y--)
+    {
+        const uint8_t* in = rgba + (size_t) y * width * 4;
+        if (filterByte)
+            *out++ = 0;
+        for (int x = 0; x < width; x++, in += 4)
+        {
+            *out++ = in[0];
+            *out++ = in[1];
+            *out++ = in[2];
+        }
+    }
+}
+
+static void encodePng(const uint8_t* rgba, int width, int height, std::vector<uint8_t>& raw, std::vector<uint8_t>& out)
+{
+    raw.resize((size_t) height * (1 + width * 3));
+    toRgbRows(rgba, width, height, true, &raw[0]);
+
+    // zlib stream of stored blocks
+    std::vector<uint8_t> zlib;
+    zlib.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+    zlib.push_back(0x78);
+    zlib.push_back(0x01);
+    uint32_t a = 1, b = 0;
+    size_t pos = 0;
+    do
+    {
+        size_t len = std::min<size_t>(raw.size() - pos, 65535);
+        zlib.push_back(pos + len == raw.size() ? 1 : 0); // BFINAL, stored
+        zlib.push_back(len & 0xff);
+        zlib.push_back(len >> 8);
+        zlib.push_back(~len & 0xff);
+        zlib.push_back((~len >> 8) & 0xff);
+        zlib.insert(zlib.end(), raw.begin() + pos, raw.begin() + pos + len);
+        for (size_t i = pos; i < pos + len; i++)
+        {
+            a = (a + raw[i]) % 65521;
+            b = (b + a) % 65521;
+        }
+        pos += len;
+    } while (pos < raw.size());
+    putBE32(zlib, (b << 16) | a);
+
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    out.assign(signature, signature + 8);
+
+    std::vector<uint8_t> ihdr;
+    putBE32(ihdr, width);
+    putBE32(ihdr, height);
+    ihdr.push_back(8); // bit depth
+    ihdr.push_back(2); // truecolor
+    ihdr.push_back(0); // deflate
+    ihdr.push_back(0); // adaptive filtering
+    ihdr.push_back(0); // no interlace
+    putChunk(out, "IHDR", &ihdr[0], ihdr.size());
+    putChunk(out, "IDAT", &zlib[0], zlib.size());
+    putChunk(out, "IEND", NULL, 0);
+}
+
+// Full-range BT.601, as C420jpeg in the Y4M header says.
+static void encodeYuv420(const uint8_t* rgba, int width, int height, std::vector<uint8_t>& out)
+{
+    int cw = (width + 1) / 2, ch = (height + 1) / 2;
+    out.resize((size_t) width * height + 2 * (size_t) cw * ch);
+    uint8_t* yPlane = &out[0];
+    uint8_t* uPlane = yPlane + (size_t) width * height;
+    uint8_t* vPlane = uPlane + (size_t) cw * ch;
+
+    for (int y = 0; y < height; y++)
+    {
+        const uint8_t* in = rgba + (size_t) (height - 1 - y) * width * 4;
+        for (int x = 0; x < width; x++, in += 4)
+            yPlane[y * width + x] = (77 * in[0] + 150 * in[1] + 29 * in[2] + 128) >> 8;
+    }
+
+    for (int cy = 0; cy < ch; cy++)
+    {
+        for (int cx = 0; cx < cw; cx++)
+        {
+            // average the 2x2 block, clamped at odd edges
+            int r = 0, g = 0, b = 0;
+            for (int dy = 0; dy < 2; dy++)
+            {
+                int y = std::min(2 * cy + dy, height - 1);
+                for (int dx = 0; dx < 2; dx++)
+                {
+                    int x = std::min(2 * cx + dx, width - 1);
+                    const uint8_t* p = rgba + ((size_t) (height - 1 - y) * width + x) * 4;
+                    r += p[0];
+                    g += p[1];
+                    b += p[2];
+                }
+            }
+            uPlane[cy * cw + cx] = (-43 * r - 85 * g + 128 * b + 4 * 32768 + 512) >> 10;
+            vPlane[cy * cw + cx] = (128 * r - 107 * g - 21 * b + 4 * 32768 + 512) >> 10;
+        }
+    }
+}
+
+// Splits a PNG file name around its single integer conversion, unescaping
+// "%%" on either side. Returns false if there is no such conversion, more
+// than one, or any other '%'; the name is never used as a format itself.
+static bool splitNamePattern(const std::string& pattern, std::string& prefix,
+                             std::string& number, std::string& suffix)
+{
+    std::string* part = &prefix;
+    prefix.clear();
+    number.clear();
+    suffix.clear();
+    for (size_t i = 0; i < pattern.size(); i++)
+    {
+        if (pattern[i] != '%')
+        {
+            *part += pattern[i];
+            continue;
+        }
+        if (i + 1 < pattern.size() && pattern[i + 1] == '%')
+        {
+            *part += '%';
+            i++;
+            continue;
+        }
+        if (part != &prefix)
+            return false;
+
+        size_t end = i + 1;
+        while (end < pattern.size() && strchr("-+ 0#", pattern[end]))
+            end++;
+        while (end < pattern.size() && isdigit((unsigned char) pattern[end]))
+            end++;
+        if (end < pattern.size() && pattern[end] == '.')
+        {
+            end++;
+            while (end < pattern.size() && isdigit((unsigned char) pattern[end]))
+                end++;
+        }
+        if (end >= pattern.size() || !strchr("diuxXo", pattern[end]) || end - i > 16)
+            return false;
+        number = pattern.substr(i, end - i + 1);
+        part = &suffix;
+        i = end;
+    }
+    return part == &suffix;
+}
+
+bool FrameWriter::start(const std::string& fileName, int width, int height, int fps)
+{
+    stop();
+
+    mFormat = captureFormatFor(fileName);
+    mFileName = fileName;
+    if (mFormat == CAPTURE_PNG && !splitNamePattern(fileName, mNamePrefix, mNumberFormat, mNameSuffix))
+    {
+        mNamePrefix = fileName.substr(0, fileName.size() - 4);
+        mNumberFormat = "%05d";
+        mNameSuffix = ".png";
+    }
+    mWidth = width;
+    mHeight = height;
+    mWritten = mDropped = 0;
+    mFailed = false;
+
+    if (mFormat != CAPTURE_PNG)
+    {
+        mFile = fopen(fileName.c_str(), "wb");
+        if (!mFile)
+            return false;
+        if (mFormat == CAPTURE_Y4M)
+            fprintf(mFile, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", width, height, fps);
+    }
+    else
+    {
+        initCrcTable();
+    }
+
+    mFree.clear();
+    mQueued.clear();
+    for (int i = 0; i < NUM_BUFFERS; i++)
+    {
+        mBuffers[i].resize((size_t) width * height * 4);
+        mFree.push_back(&mBuffers[i][0]);
+    }
+
+    mRunning = true;
+    mWriter = std::thread(&FrameWriter::writerLoop, this);
+    return true;
+}
+
+void FrameWriter::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (!mRunning)
+            return;
+        mRunning = false;
+    }
+    mWake.notify_one();
+    mFreed.notify_all();
+    mWriter.join(); // the worker writes the queued frames before exiting
+
+    if (mFile)
+        fclose(mFile);
+    mFile = 0;
+}
+
+uint8_t* FrameWriter::acquire(bool wait)
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    if (wait)
+        mFreed.wait(lock, [this] { return !mFree.empty() || !mRunning; });
+    if (mFree.empty() || !mRunning)
+    {
+        mDropped++;
+        return NULL;
+    }
+    uint8_t* frame = mFree.front();
+    mFree.pop_front();
+    return frame;
+}
+
+void FrameWriter::submit(uint8_t* frame)
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mQueued.push_back(frame);
+    }
+    mWake.notify_one();
+}
+
+bool FrameWriter::writeFrame(const uint8_t* rgba)
+{
+    switch (mFormat)
+    {
+    case CAPTURE_RAW:
+        mScratch.resize((size_t) mWidth * mHeight * 3);
+        toRgbRows(rgba, mWidth, mHeight, false, &mScratch[0]);
+        return fwrite(&mScratch[0], 1, mScratch.size(), mFile) == mScratch.size();
+
+    case CAPTURE_Y4M:
+        encodeYuv420(rgba, mWidth, mHeight, mScratch);
+        return fputs("FRAME\n", mFile) >= 0 &&
+               fwrite(&mScratch[0], 1, mScratch.size(), mFile) == mScratch.size();
+
+    case CAPTURE_PNG:
+    {
+        encodePng(rgba, mWidth, mHeight, mScratch, mEncoded);
+
+        // mNumberFormat is a single checked integer conversion
+        char number[64];
+        snprintf(number, sizeof(number), mNumberFormat.c_str(), mWritten);
+        std::string name = mNamePrefix + number + mNameSuffix;
+        FILE* file = fopen(name.c_str(), "wb");
+        if (!file)
+            return false;
+        bool ok = fwrite(&mEncoded[0], 1, mEncoded.size(), file) == mEncoded.size();
+        return fclose(file) == 0 && ok;
+    }
+    }
+    return false;
+}
+
+void FrameWriter::writerLoop()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (true)
+    {
+        mWake.wait(lock, [this] { return !mQueued.empty() || !mRunning; });
+        if (mQueued.empty())
+            break;
+
+        uint8_t* frame = mQueued.front();
+        mQueued.pop_front();
+
+        lock.unlock();
+        bool ok = mFailed || writeFrame(frame);
+        lock.lock();
+
+        if (!ok && !mFailed)
+        {
+            fprintf(stderr, "Frame capture to %s failed\n", mFileName.c_str());
+            mFailed = true; // keep draining so the renderer is not held up
+        }
+        if (ok && !mFailed)
+            mWritten++;
+        mFree.push_back(frame);
+        mFreed.notify_one();
+    }
+}
@@ -0,0 +1,80 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Gameplay capture. The renderer reads finished frames back through pixel
+// buffer objects and copies them into buffers handed out by FrameWriter,
+// whose worker thread encodes and writes them. The writer never blocks the
+// renderer: when it falls behind, acquire() fails and the frame is dropped.
+
+enum CaptureFormat
+{
+    CAPTURE_RAW, // packed RGB24, top row first, frames back to back
+    CAPTURE_Y4M, // YUV4MPEG2, 4:2:0
+    CAPTURE_PNG, // one uncompressed PNG per frame
+};
+
+/// Picks the format from the file name: ".y4m", ".png" (a numbered
+/// sequence, see FrameWriter::start) or anything else for raw.
+CaptureFormat captureFormatFor(const std::string& fileName);
+
+class FrameWriter
+{
+public:
+    static const int NUM_BUFFERS = 8; // frames that can wait for the worker
+
+    FrameWriter() : mFormat(CAPTURE_RAW), mWidth(0), mHeight(0), mFile(0), mWritten(0), mDropped(0),
+                    mRunning(false), mFailed(false) { }
+    ~FrameWriter() { stop(); }
+
+    /// For PNG sequences the file name may hold one integer conversion such
+    /// as "shots/frame%05d.png" (and "%%" for a literal '%'); otherwise the
+    /// frame number is appended before the extension.
+    bool start(const std::string& fileName, int width, int height, int fps);
+
+    /// Writes the frames still queued and closes the output.
+    void stop();
+
+    bool enabled() const { return mRunning; }
+    int width() const { return mWidth; }
+    int height() const { return mHeight; }
+
+    /// A free buffer for one frame of width * height RGBA pixels, bottom row
+    /// first as glReadPixels returns them, or null if the worker is behind
+    /// and `wait` is false.
+    uint8_t* acquire(bool wait = false);
+
+    /// Queues a buffer returned by acquire() for writing.
+    void submit(uint8_t* frame);
+
+    int written() const { return mWritten; }
+    int dropped() const { return mDropped; }
+
+private:
+    void writerLoop();
+    bool writeFrame(const uint8_t* rgba);
+
+    CaptureFormat mFormat;
+    std::string mFileName;
+    std::string mNamePrefix, mNumberFormat, mNameSuffix; // PNG file names around the frame number
+    int mWidth, mHeight;
+    FILE* mFile; // raw and Y4M
+    std::vector<uint8_t> mScratch, mEncoded; // one converted frame, reused
+    int mWritten, mDropped;
+
+    std::vector<uint8_t> mBuffers[NUM_BUFFERS];
+    std::deque<uint8_t*> mFree, mQueued;
+    bool mRunning, mFailed;
+    std::mutex mMutex;
+    std::condition_variable mWake, mFreed;
+    std::thread mWriter;
+};
+
+#endif
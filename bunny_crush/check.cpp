@@ -0,0 +1,75 @@
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "board.h"
+#include "game.h"
+
+// Checks that the animated Game plays by the rules in board.h: every move
+// is clicked on a Game and ticked until the board is idle, and the same
+// move is played with playMove() on a copy of the board and Rng taken
+// before the click. The boards, generators and scores must match after
+// every move.
+//
+//   make check
+//
+// Prints one line per grid size and exits with 1 on the first mismatch.
+
+const int MAX_TICKS = 1000000; // per move, far more than any cascade takes
+
+static bool checkGame(int rows, int cols, uint64_t seed, int numMoves)
+{
+    Game game;
+    game.rng = Rng(seed);
+    game.reset(rows, cols);
+    Rng picker(seed + 1);
+
+    std::vector<uint8_t> cells, matched(rows * cols, 0);
+    for (int move = 0; move < numMoves; move++)
+    {
+        cells = game.cells;
+        Rng rng = game.rng;
+        int score = game.numOfMatched;
+
+        int row = picker.below(rows), col = picker.below(cols);
+        if (!game.click(row, col))
+        {
+            printf("%dx%d seed %llu move %d: click ignored on an idle board\n", cols, rows,
+                   (unsigned long long) seed, move);
+            return false;
+        }
+        int ticks = 0;
+        while (!game.idle() && ticks++ < MAX_TICKS)
+            game.tick();
+
+        MoveResult result = playMove(&cells[0], &matched[0], rows, cols, row, col, rng);
+        if (!game.idle() || cells != game.cells || rng.state != game.rng.state ||
+            score + result.score != game.numOfMatched)
+        {
+            printf("%dx%d seed %llu move %d: the game and playMove() differ after clicking (%d, %d)\n", cols,
+                   rows, (unsigned long long) seed, move, row, col);
+            return false;
+        }
+
+        // let an idle tick reshuffle a dead board, as the game does
+        game.tick();
+    }
+    return true;
+}
+
+int main()
+{
+    static const int SIZES[][2] = {{8, 8}, {9, 9}, {10, 10}, {16, 16}, {12, 2}, {7, 13}};
+    const int GAMES = 30, MOVES = 300;
+
+    for (size_t s = 0; s < sizeof(SIZES) / sizeof(SIZES[0]); s++)
+    {
+        int rows = SIZES[s][0], cols = SIZES[s][1];
+        for (int g = 0; g < GAMES; g++)
+        {
+            if (!checkGame(rows, cols, 1000 * s + g, MOVES))
+                return 1;
+        }
+        printf("%dx%d: %d moves match playMove()\n", cols, rows, GAMES * MOVES);
+    }
+    return 0;
+}
@@ -0,0 +1,364 @@
+// Board rules as compute passes, see gpuboard.h. gpuboard.cpp compiles this
+// file once per pass, after "#version 430" and a #define naming the pass.
+
+#define PHASE_IDLE 0u
+#define PHASE_MARK 1u
+#define PHASE_COLLAPSE 2u
+
+#define NUM_COLORS 5u
+#define MAX_CLICKS 64u
+
+// flag bits per cell: vertical and horizontal coverage of even and odd
+// mark iterations, and whether the last iteration marked the tile
+#define COVER_V 1u
+#define COVER_H 2u
+#define MARKED 16u
+
+uniform ivec2 size; // rows, cols
+
+layout(std430, binding = 0) buffer Cells { uint cells[]; };
+layout(std430, binding = 1) buffer Flags { uint flags[]; };
+layout(std430, binding = 2) buffer Columns { uint columns[]; }; // tiles removed per column, then their prefix sums
+
+layout(std430, binding = 3) buffer State
+{
+    uint phase;
+    uint iteration;    // of the mark pass, from 1; 0 before the first
+    uint changed;      // cells whose coverage changed in the last mark pass
+    uint marked;       // tiles marked by the last mark pass
+    uint roundScore;   // and the score they are worth
+    uint score;
+    uint moves;
+    uint removedTotal; // tiles removed by the last collapse
+    uvec2 rng;         // xorshift64* state, low word first
+    uint clickHead;    // written by the CPU
+    uint clickTail;
+    uint cascades;
+    uint pad[3];
+    uvec4 dispatchArgs[4]; // mark, collapse, scan, refill
+    uvec2 clicks[MAX_CLICKS];
+};
+
+// jumps[k * 64 + b] is the state reached from state bit b alone after 2^k steps
+layout(std430, binding = 4) readonly buffer Jumps { uvec2 jumps[]; };
+
+// xorshift step on (low, high) words, as Rng::next()
+uvec2 rngStep(uvec2 s)
+{
+    s ^= uvec2((s.x >> 12) | (s.y << 20), s.y >> 12);
+    s ^= uvec2(s.x << 25, (s.y << 25) | (s.x >> 7));
+    s ^= uvec2((s.x >> 27) | (s.y << 5), s.y >> 27);
+    return s;
+}
+
+// Rng::below() on an already stepped state
+uint rngBelow(uvec2 s, uint n)
+{
+    const uint mulLow = 0x4F6CDD1Du, mulHigh = 0x2545F491u;
+    uint high, low;
+    umulExtended(s.x, mulLow, high, low);
+    uint value = high + s.x * mulHigh + s.y * mulLow;
+    umulExtended(value, n, high, low);
+    return high;
+}
+
+// the state after n steps
+uvec2 rngJump(uvec2 s, uint n)
+{
+    for (int k = 0; n != 0u; k++, n >>= 1)
+    {
+        if ((n & 1u) == 0u)
+            continue;
+        uvec2 next = uvec2(0u);
+        for (int b = 0; b < 64; b++)
+        {
+            uint word = b < 32 ? s.x : s.y;
+            if (((word >> (b & 31)) & 1u) != 0u)
+                next ^= jumps[k * 64 + b];
+        }
+        s = next;
+    }
+    return s;
+}
+
+#ifdef CONTROL
+
+layout(local_size_x = 1) in;
+
+uniform uvec3 cellGroups;   // one thread per cell
+uniform uvec3 columnGroups; // one thread per column
+
+void popTile(int row, int col)
+{
+    int cols = size.y;
+    for (int i = row; i > 0; i--)
+        cells[i * cols + col] = cells[(i - 1) * cols + col];
+    rng = rngStep(rng);
+    cells[col] = rngBelow(rng, NUM_COLORS);
+}
+
+void main()
+{
+    bool collapse = false;
+
+    if (phase == PHASE_COLLAPSE)
+    {
+        // the collapse passes ran last time
+        rng = rngJump(rng, removedTotal);
+        phase = PHASE_MARK;
+        iteration = 0u;
+    }
+    else if (phase == PHASE_MARK && iteration > 0u && changed == 0u)
+    {
+        // the coverage settled
+        if (marked == 0u)
+        {
+            phase = PHASE_IDLE;
+        }
+        else
+        {
+            score += roundScore;
+            cascades++;
+            phase = PHASE_COLLAPSE;
+            collapse = true;
+        }
+    }
+
+    if (phase == PHASE_IDLE && clickTail != clickHead)
+    {
+        uvec2 click = clicks[clickTail % MAX_CLICKS];
+        popTile(int(click.x), int(click.y));
+        clickTail++;
+        moves++;
+        cascades = 0u;
+        phase = PHASE_MARK;
+        iteration = 0u;
+    }
+
+    bool mark = phase == PHASE_MARK;
+    if (mark)
+    {
+        iteration++;
+        changed = 0u;
+        marked = 0u;
+        roundScore = 0u;
+    }
+
+    dispatchArgs[0] = mark ? uvec4(cellGroups, 0u) : uvec4(0u, 1u, 1u, 0u);
+    dispatchArgs[1] = collapse ? uvec4(columnGroups, 0u) : uvec4(0u, 1u, 1u, 0u);
+    dispatchArgs[2] = collapse ? uvec4(1u, 1u, 1u, 0u) : uvec4(0u, 1u, 1u, 0u);
+    dispatchArgs[3] = collapse ? uvec4(columnGroups, 0u) : uvec4(0u, 1u, 1u, 0u);
+}
+
+#endif
+
+#ifdef MARK
+
+// One iteration of the coverage rules. A run is a same-colored segment of
+// three or more; it starts at its first tile, among those that leave at
+// least three, that the crossing direction does not cover, and covers the
+// tiles after its start. Once an iteration changes no cover bit, its marks
+// are final.
+
+layout(local_size_x = 256) in;
+
+shared uint groupChanged, groupMarked, groupScore;
+
+uint previousCover(int k, uint shift)
+{
+    return iteration == 1u ? 0u : (flags[k] >> shift) & 3u;
+}
+
+void main()
+{
+    if (gl_LocalInvocationIndex == 0u)
+    {
+        groupChanged = 0u;
+        groupMarked = 0u;
+        groupScore = 0u;
+    }
+    barrier();
+
+    int rows = size.x, cols = size.y;
+    uint index = (gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x) * 256u + gl_LocalInvocationIndex;
+    if (index < uint(rows * cols))
+    {
+        int k = int(index);
+        int i = k / cols, j = k % cols;
+        uint color = cells[k];
+        uint readShift = (iteration & 1u) == 0u ? 2u : 0u;
+        uint writeShift = 2u - readShift;
+
+        uint cover = 0u;
+        bool isMarked = false;
+        uint score = 0u;
+
+        // vertical segment [top, bottom] through the tile
+        int top = i, bottom = i;
+        while (top > 0 && cells[k - (i - top + 1) * cols] == color)
+            top--;
+        while (bottom + 1 < rows && cells[k + (bottom - i + 1) * cols] == color)
+            bottom++;
+        if (bottom - top >= 2)
+        {
+            int start = top;
+            while (start <= bottom - 2 && (previousCover(start * cols + j, readShift) & COVER_H) != 0u)
+                start++;
+            if (start <= bottom - 2 && i >= start)
+            {
+                isMarked = true;
+                if (i > start)
+                    cover |= COVER_V;
+                else
+                    score += uint(bottom - start + 1);
+            }
+        }
+
+        // horizontal segment [left, right]
+        int left = j, right = j;
+        while (left > 0 && cells[k - (j - left + 1)] == color)
+            left--;
+        while (right + 1 < cols && cells[k + (right - j + 1)] == color)
+            right++;
+        if (right - left >= 2)
+        {
+            int start = left;
+            while (start <= right - 2 && (previousCover(i * cols + start, readShift) & COVER_V) != 0u)
+                start++;
+            if (start <= right - 2 && j >= start)
+            {
+                isMarked = true;
+                if (j > start)
+                    cover |= COVER_H;
+                else
+                    score += uint(right - start + 1);
+            }
+        }
+
+        // a cover bit is only read by a run crossing the tile; keeping just
+        // those lets a cascade without crossings settle in one pass
+        cover &= (bottom - top >= 2 ? COVER_H : 0u) | (right - left >= 2 ? COVER_V : 0u);
+
+        // only this thread writes this word; the others read the bits it keeps
+        uint word = flags[k];
+        if (cover != previousCover(k, readShift))
+            atomicAdd(groupChanged, 1u);
+        flags[k] = (word & ~((3u << writeShift) | MARKED)) | (cover << writeShift) | (isMarked ? MARKED : 0u);
+        if (isMarked)
+            atomicAdd(groupMarked, 1u);
+        if (score > 0u)
+            atomicAdd(groupScore, score);
+    }
+
+    barrier();
+    if (gl_LocalInvocationIndex == 0u)
+    {
+        if (groupChanged > 0u)
+            atomicAdd(changed, groupChanged);
+        if (groupMarked > 0u)
+            atomicAdd(marked, groupMarked);
+        if (groupScore > 0u)
+            atomicAdd(roundScore, groupScore);
+    }
+}
+
+#endif
+
+#ifdef COLLAPSE
+
+// Moves the surviving tiles of a column to its bottom and counts the gap
+// left at the top.
+
+layout(local_size_x = 64) in;
+
+void main()
+{
+    int rows = size.x, cols = size.y;
+    int j = int(gl_GlobalInvocationID.x);
+    if (j >= cols)
+        return;
+
+    int dst = rows - 1;
+    for (int i = rows - 1; i >= 0; i--)
+    {
+        int k = i * cols + j;
+        if ((flags[k] & MARKED) == 0u)
+        {
+            cells[dst * cols + j] = cells[k];
+            dst--;
+        }
+    }
+    columns[j] = uint(dst + 1);
+}
+
+#endif
+
+#ifdef SCAN
+
+// Exclusive prefix sums of the removed counts, the Rng draws made by the
+// columns before each column.
+
+layout(local_size_x = 256) in;
+
+shared uint sums[256];
+
+void main()
+{
+    int cols = size.y;
+    int t = int(gl_LocalInvocationIndex);
+    int chunk = (cols + 255) / 256;
+    int begin = min(t * chunk, cols), end = min(begin + chunk, cols);
+
+    uint sum = 0u;
+    for (int j = begin; j < end; j++)
+        sum += columns[j];
+    sums[t] = sum;
+    barrier();
+
+    for (int step = 1; step < 256; step *= 2)
+    {
+        uint add = t >= step ? sums[t - step] : 0u;
+        barrier();
+        sums[t] += add;
+        barrier();
+    }
+
+    uint offset = sums[t] - sum;
+    for (int j = begin; j < end; j++)
+    {
+        columns[cols + j] = offset;
+        offset += columns[j];
+    }
+    if (t == 255)
+        removedTotal = sums[255];
+}
+
+#endif
+
+#ifdef REFILL
+
+// Fills the gap at the top of each column from the bottom up, as
+// collapseColumn() does.
+
+layout(local_size_x = 64) in;
+
+void main()
+{
+    int cols = size.y;
+    int j = int(gl_GlobalInvocationID.x);
+    if (j >= cols)
+        return;
+
+    int removed = int(columns[j]);
+    if (removed == 0)
+        return;
+
+    uvec2 s = rngJump(rng, columns[cols + j]);
+    for (int i = removed - 1; i >= 0; i--)
+    {
+        s = rngStep(s);
+        cells[i * cols + j] = rngBelow(s, NUM_COLORS);
+    }
+}
+
+#endif
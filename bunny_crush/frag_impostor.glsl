@@ -0,0 +1,17 @@
+#version 120
+
+uniform sampler2D atlas;
+uniform vec2 cellSize; // one atlas cell in texture coordinates
+
+varying vec2 cell;
+
+void main(void)
+{
+	// gl_PointCoord starts at the top, the atlas at the bottom
+	vec2 uv = (cell + vec2(gl_PointCoord.x, 1.0 - gl_PointCoord.y)) * cellSize;
+	vec4 color = texture2D(atlas, uv);
+	if (color.a < 0.5)
+		discard;
+
+	gl_FragColor = vec4(color.rgb, 1);
+}
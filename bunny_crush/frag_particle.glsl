@@ -0,0 +1,14 @@
+#version 120
+
+varying vec4 color;
+
+void main(void)
+{
+	// round, soft-edged points
+	vec2 d = gl_PointCoord - vec2(0.5, 0.5);
+	float r2 = dot(d, d);
+	if (r2 > 0.25)
+		discard;
+
+	gl_FragColor = vec4(color.rgb, color.a * (1.0 - 4.0 * r2));
+}
@@ -0,0 +1,377 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "game.h"
+#include "particles.h"
+#include "savestate.h"
+#include "telemetry.h"
+#include "trace.h"
+
+// Per-tick animation speeds, unchanged from the original per-frame values
+// at 60 Hz: popping tiles grow by 0.01 up to 1.5, falling tiles move 0.05
+// world units on a board that is 19 units tall.
+const float POP_SPEED = 0.01f;
+const float POP_SCALE = 1.5f;
+const float FALL_SPEED = 0.05f / 19.f; // board heights per tick
+
+void Game::reset(int rows, int cols)
+{
+    this->rows = rows;
+    this->cols = cols;
+    cells.resize(rows * cols);
+    marks.assign(rows * cols, 0);
+    fall.assign(rows * cols, 0);
+    tasks.clear();
+    columnTask.assign(cols, -1);
+
+    // start without runs of three and with at least one productive move
+    generateBoard(&cells[0], rows, cols, rng);
+    moves.build(&cells[0], rows, cols);
+
+    event = EVENT_IDLE;
+    pressRow = pressCol = -1;
+    moveCounter = 0;
+    numOfMatched = 0;
+    cascadeDepth = 0;
+    matchesPending = false;
+}
+
+bool Game::click(int row, int col)
+{
+    if (!tasks.empty() || row < 0 || row >= rows || col < 0 || col >= cols)
+        return false;
+
+    pressRow = row;
+    pressCol = col;
+    marks[row * cols + col] = 1;
+    moveCounter++;
+    cascadeDepth = 0;
+    startTask(TASK_POP, col, 1.01f);
+    updateEvent();
+    if (telemetry)
+        telemetry->push(TELEMETRY_MOVE, row, col);
+    return true;
+}
+
+void Game::startTask(int type, int column, float progress)
+{
+    AnimationTask task = {(uint8_t) type, column, progress, type == TASK_POP ? POP_SCALE : 0.f};
+    columnTask[column] = tasks.size();
+    tasks.push_back(task);
+}
+
+void Game::finishTask(size_t t)
+{
+    columnTask[tasks[t].column] = -1;
+    if (t + 1 != tasks.size())
+    {
+        tasks[t] = tasks.back();
+        columnTask[tasks[t].column] = t;
+    }
+    tasks.pop_back();
+}
+
+// Removes the marked tiles of `column` and returns how many rows its
+// tiles fall. Each surviving tile falls by the number of marked tiles
+// below it; the new tiles at the top start above the board by as many
+// rows as were removed.
+int Game::collapse(int column)
+{
+    TRACE_ZONE("collapse");
+    int removed = 0, lowest = -1;
+    for (int i = rows - 1; i >= 0; i--)
+    {
+        int k = i * cols + column;
+        if (marks[k])
+        {
+            removed++;
+            if (lowest < 0)
+                lowest = i;
+            if (bursts)
+            {
+                Burst burst = {(int16_t) i, (int16_t) column, cells[k]};
+                bursts->push(burst);
+            }
+        }
+        else
+        {
+            fall[(i + removed) * cols + column] = removed;
+        }
+    }
+    for (int i = 0; i < removed; i++)
+        fall[i * cols + column] = removed;
+
+    collapseColumn(&cells[0], &marks[0], rows, cols, column, rng);
+
+    // only the column's cells above its lowest removed tile changed
+    for (int i = 0; i <= lowest; i++)
+        moves.cellChanged(&cells[0], i, column);
+    return removed;
+}
+
+void Game::shuffle()
+{
+    TRACE_ZONE("shuffle");
+    if (!shuffleBoard(&cells[0], rows, cols, rng))
+        generateBoard(&cells[0], rows, cols, rng); // tiles too uneven to rearrange
+    moves.build(&cells[0], rows, cols);
+    if (telemetry)
+        telemetry->push(TELEMETRY_SHUFFLE, moveCounter, 0);
+}
+
+// Collapses the columns whose pops have finished, in column order as
+// playMove() does, then looks for the next round's runs.
+void Game::collapsePopped()
+{
+    for (int j = 0; j < cols; j++)
+    {
+        int t = columnTask[j];
+        if (t < 0 || tasks[t].type != TASK_POP || tasks[t].progress <= POP_SCALE)
+            continue;
+        tasks[t].type = TASK_FALL;
+        tasks[t].progress = 0;
+        tasks[t].end = collapse(j);
+    }
+    resolveMatches();
+}
+
+bool Game::columnMarked(int column) const
+{
+    for (int i = 0; i < rows; i++)
+    {
+        if (marks[i * cols + column])
+            return true;
+    }
+    return false;
+}
+
+// Marks the next round's runs. The board already holds every tile at its
+// final place, even those still falling, so the round is the one
+// playMove() would find.
+void Game::resolveMatches()
+{
+    TRACE_ZONE("match");
+    int score = markMatches(&cells[0], &marks[0], rows, cols);
+    if (score == 0)
+        return;
+
+    numOfMatched += score;
+    cascadeDepth++;
+    if (telemetry)
+    {
+        telemetry->push(TELEMETRY_MATCH, std::count(marks.begin(), marks.end(), 1), 0);
+        telemetry->push(TELEMETRY_SCORE, moveCounter, score);
+        telemetry->push(TELEMETRY_CASCADE, cascadeDepth, 0);
+    }
+
+    matchesPending = true;
+    startPops();
+}
+
+// Starts the pending round's pops once none of its columns is falling, all
+// at once so that they also finish on the same tick.
+void Game::startPops()
+{
+    for (int j = 0; j < cols; j++)
+    {
+        if (columnTask[j] >= 0 && columnMarked(j))
+            return;
+    }
+    for (int j = 0; j < cols; j++)
+    {
+        if (columnMarked(j))
+            startTask(TASK_POP, j, 1.01f);
+    }
+    matchesPending = false;
+}
+
+void Game::updateEvent()
+{
+    bool popping = false, falling = false;
+    for (size_t t = 0; t < tasks.size(); t++)
+    {
+        popping = popping || tasks[t].type == TASK_POP;
+        falling = falling || tasks[t].type == TASK_FALL;
+    }
+
+    // pending matches count as popping, so that a snapshot keeps their marks
+    if (popping || matchesPending)
+        event = cascadeDepth == 0 ? EVENT_POP : EVENT_POP_MATCHES;
+    else if (falling)
+        event = cascadeDepth == 0 ? EVENT_DROP : EVENT_FALL;
+    else
+        event = EVENT_IDLE;
+}
+
+void Game::tick()
+{
+    angle += 0.5;
+
+    if (tasks.empty())
+    {
+        TRACE_ZONE("idle");
+        // a move completes a row on boards of at least 2x3, or a column on
+        // boards of at least four rows; smaller boards never have one
+        if (((rows >= 2 && cols >= 3) || rows >= 4) && !moves.anyMove())
+            shuffle();
+        return;
+    }
+
+    bool poppedAny = false, settledAny = false;
+    {
+        TRACE_ZONE("animate");
+        for (size_t t = 0; t < tasks.size();)
+        {
+            AnimationTask& task = tasks[t];
+            if (task.type == TASK_POP)
+            {
+                task.progress += POP_SPEED;
+                poppedAny = poppedAny || task.progress > POP_SCALE;
+                t++;
+                continue;
+            }
+
+            task.progress += FALL_SPEED * rows;
+            if (task.progress < task.end)
+            {
+                t++;
+                continue;
+            }
+            for (int i = 0; i < rows; i++)
+                fall[i * cols + task.column] = 0;
+            finishTask(t); // moves the last task to t
+            settledAny = true;
+        }
+    }
+
+    if (poppedAny)
+        collapsePopped();
+    else if (settledAny && matchesPending)
+        startPops();
+    updateEvent();
+}
+
+void Game::fillFrame(BoardFrame& frame) const
+{
+    frame.rows = rows;
+    frame.cols = cols;
+    frame.angle = angle;
+    frame.moveCounter = moveCounter;
+    frame.score = numOfMatched;
+    frame.tiles.resize(rows * cols);
+
+    for (int i = 0; i < rows; i++)
+    {
+        for (int j = 0; j < cols; j++)
+        {
+            int k = i * cols + j;
+            TileView& tile = frame.tiles[k];
+            tile.colorId = cells[k];
+            tile.row = i;
+            tile.scale = 1;
+        }
+    }
+
+    for (size_t t = 0; t < tasks.size(); t++)
+    {
+        const AnimationTask& task = tasks[t];
+        for (int i = 0; i < rows; i++)
+        {
+            int k = i * cols + task.column;
+            if (task.type == TASK_POP && marks[k])
+                frame.tiles[k].scale = task.progress;
+            if (task.type == TASK_FALL && fall[k] > task.progress)
+                frame.tiles[k].row = i - (fall[k] - task.progress);
+        }
+    }
+}
+
+// Snapshots predate the tasks and keep one scale and one fall progress for
+// the whole board: the first running pop and fall stand in for the rest.
+void Game::capture(GameSnapshot& snapshot) const
+{
+    float scaling = 1.01f, progress = 0;
+    bool popFound = false, fallFound = false;
+    for (size_t t = 0; t < tasks.size(); t++)
+    {
+        if (tasks[t].type == TASK_POP && !popFound)
+        {
+            scaling = tasks[t].progress;
+            popFound = true;
+        }
+        if (tasks[t].type == TASK_FALL && !fallFound)
+        {
+            progress = tasks[t].progress;
+            fallFound = true;
+        }
+    }
+
+    snapshot.rows = rows;
+    snapshot.cols = cols;
+    snapshot.colors.assign(cells.begin(), cells.end());
+    snapshot.flags.assign(marks.begin(), marks.end()); // marks are SNAPSHOT_MARKED, set only while popping
+    snapshot.event = event;
+    snapshot.pressRow = pressRow;
+    snapshot.pressCol = pressCol;
+    snapshot.moveCounter = moveCounter;
+    snapshot.numOfMatched = numOfMatched;
+    snapshot.angle = angle;
+    snapshot.scaling = scaling;
+    snapshot.progress = progress;
+    snapshot.rngState = rng.state;
+}
+
+// Falls in progress are not restored: their tiles are already in place in
+// the snapshot, so they land at once. Pops resume at the saved scale.
+bool Game::restore(const GameSnapshot& snapshot)
+{
+    if (snapshot.rows != rows || snapshot.cols != cols || snapshot.event < EVENT_IDLE || snapshot.event > EVENT_FALL)
+        return false;
+    // a NaN scale would never finish its pop, and a zero state makes the
+    // generator return the same color forever
+    if (!std::isfinite(snapshot.scaling) || !std::isfinite(snapshot.angle) || !std::isfinite(snapshot.progress) ||
+        snapshot.rngState == 0)
+        return false;
+    // -1 before the first click
+    if (snapshot.pressRow < -1 || snapshot.pressRow >= rows || snapshot.pressCol < -1 || snapshot.pressCol >= cols ||
+        (snapshot.pressRow < 0) != (snapshot.pressCol < 0))
+        return false;
+
+    // older saves keep the marks of removed tiles while they fall
+    bool removed = snapshot.event == EVENT_DROP || snapshot.event == EVENT_FALL;
+
+    cells = snapshot.colors;
+    for (int k = 0; k < rows * cols; k++)
+        marks[k] = removed ? 0 : snapshot.flags[k] & SNAPSHOT_MARKED;
+    std::fill(fall.begin(), fall.end(), 0);
+    moves.build(&cells[0], rows, cols);
+
+    pressRow = snapshot.pressRow;
+    pressCol = snapshot.pressCol;
+    moveCounter = snapshot.moveCounter;
+    numOfMatched = snapshot.numOfMatched;
+    cascadeDepth = snapshot.event == EVENT_POP_MATCHES || snapshot.event == EVENT_FALL;
+    angle = snapshot.angle;
+    rng.state = snapshot.rngState;
+
+    tasks.clear();
+    columnTask.assign(cols, -1);
+    matchesPending = false;
+    float scaling = std::min(std::max(snapshot.scaling, 1.01f), POP_SCALE);
+    for (int j = 0; j < cols; j++)
+    {
+        for (int i = 0; i < rows; i++)
+        {
+            if (marks[i * cols + j])
+            {
+                startTask(TASK_POP, j, scaling);
+                break;
+            }
+        }
+    }
+
+    if (tasks.empty())
+        resolveMatches(); // a snapshot taken mid-fall or in EVENT_MATCH may hold runs
+    updateEvent();
+    return true;
+}
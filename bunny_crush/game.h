@@ -0,0 +1,139 @@
+#ifndef GAME_H
+#define GAME_H
+
+#include <cstdint>
+#include <vector>
+#include "board.h"
+
+class BurstQueue;
+class Telemetry;
+struct GameSnapshot;
+
+// The animated game. Game owns one board and steps its animations one
+// fixed tick at a time; it never touches OpenGL. What should be drawn is
+// written into a BoardFrame, which the renderer reads on its own thread.
+//
+// Animations run per column as AnimationTasks: a column's marked tiles
+// grow, then the column collapses and its tiles fall into the gaps. Falls
+// run independently, so a short fall does not wait for a long one.
+//
+// The outcome is still that of playMove(). Once a round's columns have
+// collapsed, markMatches() finds the next round's runs on the whole board.
+// Their pops start together as soon as every column holding one has
+// landed, while the other columns keep falling, and end together; the
+// columns then collapse in column order, so refills draw from the Rng in
+// the same order.
+
+/// Summary of what the board is doing, for input handling, spectators
+/// and save states
+enum GameEvent
+{
+    EVENT_IDLE = 0,        // waiting for a click
+    EVENT_POP = 1,         // the clicked tile scales up
+    EVENT_DROP = 2,        // the tiles above it drop into the gap
+    EVENT_MATCH = 3,       // look for runs of three (only in old saves)
+    EVENT_POP_MATCHES = 4, // matched tiles wait for their columns to land or scale up, maybe while others fall
+    EVENT_FALL = 5,        // the tiles above them fall, new tiles enter
+};
+
+enum TaskType
+{
+    TASK_POP,  // the column's marked tiles grow
+    TASK_FALL, // the column has collapsed and its tiles fall into place
+};
+
+/// The running animation of one column. A pop turns into the column's
+/// fall when it finishes.
+struct AnimationTask
+{
+    uint8_t type; // TaskType
+    int column;
+    float progress; // scale of the popping tiles, or rows fallen
+    float end;      // progress at which the task is done
+};
+
+/// How one tile is drawn
+struct TileView
+{
+    uint8_t colorId;
+    float row;   // fractional while falling, negative above the board
+    float scale; // 1 at rest
+};
+
+/// Everything the renderer needs for one frame of one board
+struct BoardFrame
+{
+    BoardFrame() : rows(0), cols(0), angle(0), moveCounter(0), score(0), inputTimeUs(0) { }
+
+    int rows, cols;
+    float angle;
+    int moveCounter, score;
+    int64_t inputTimeUs; // newest input the simulation had taken when it made the frame
+    std::vector<TileView> tiles; // row-major, rows * cols
+};
+
+struct Game
+{
+    Game() : rows(0), cols(0), event(EVENT_IDLE), pressRow(-1), pressCol(-1), moveCounter(0),
+             numOfMatched(0), cascadeDepth(0), angle(0), telemetry(0), bursts(0), matchesPending(false) { }
+
+    /// Starts a new board.
+    void reset(int rows, int cols);
+
+    /// Clicks a tile. Ignored (returns false) unless the board is idle.
+    bool click(int row, int col);
+
+    /// Advances every running animation by one tick.
+    void tick();
+
+    bool idle() const { return tasks.empty(); }
+
+    void fillFrame(BoardFrame& frame) const;
+
+    void capture(GameSnapshot& snapshot) const;
+
+    /// Returns false, leaving the game as it was, if the snapshot is for
+    /// another grid size or its state cannot be resumed.
+    bool restore(const GameSnapshot& snapshot);
+
+    /// Heap bytes held by the board state.
+    size_t memoryUsage() const
+    {
+        return cells.capacity() + marks.capacity() + fall.capacity() +
+               tasks.capacity() * sizeof(AnimationTask) + columnTask.capacity() * sizeof(int) + moves.memoryUsage();
+    }
+
+    int rows, cols;
+    std::vector<uint8_t> cells; // color ids, row-major
+    std::vector<uint8_t> marks; // tiles being popped (clicked or matched)
+    std::vector<uint8_t> fall;  // rows each tile still has to fall, indexed by its final cell
+    MoveIndex moves;
+    Rng rng;
+
+    std::vector<AnimationTask> tasks; // running, at most one per column
+    std::vector<int> columnTask;      // index into tasks, -1 while the column is settled
+
+    int event; // GameEvent, kept up to date from the tasks
+    int pressRow, pressCol;
+    int moveCounter, numOfMatched;
+    int cascadeDepth; // match rounds since the last click
+    float angle;      // spin of every tile, degrees
+
+    Telemetry* telemetry; // optional
+    BurstQueue* bursts;   // optional, receives every tile that vanishes
+
+private:
+    void startTask(int type, int column, float progress);
+    void finishTask(size_t t);
+    int collapse(int column);
+    void collapsePopped();
+    bool columnMarked(int column) const;
+    void resolveMatches();
+    void startPops();
+    void updateEvent();
+    void shuffle();
+
+    bool matchesPending; // marks waiting for their columns to land
+};
+
+#endif
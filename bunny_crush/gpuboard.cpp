@@ -0,0 +1,451 @@
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include "gpuboard.h"
+#include "trace.h"
+
+static const int JUMP_LEVELS = 32; // enough to skip 2^32 - 1 draws
+static const uint32_t PHASE_IDLE = 0;
+
+static bool readFile(const char* fileName, std::string& data)
+{
+    std::ifstream file(fileName);
+    if (!file)
+        return false;
+    std::stringstream text;
+    text << file.rdbuf();
+    data = text.str();
+    return true;
+}
+
+// Compiles and attaches one stage. The sources are concatenated in order.
+static bool attachShader(GLuint program, GLenum stage, const char* fileName, const char* prefix)
+{
+    std::string source;
+    if (!readFile(fileName, source))
+    {
+        printf("Cannot find file name: %s\n", fileName);
+        return false;
+    }
+
+    const GLchar* sources[2] = {prefix, source.c_str()};
+    GLuint shader = glCreateShader(stage);
+    glShaderSource(shader, 2, sources, NULL);
+    glCompileShader(shader);
+
+    GLint ok = GL_FALSE;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+    if (!ok)
+    {
+        char output[1024] = {0};
+        glGetShaderInfoLog(shader, sizeof(output), NULL, output);
+        printf("%s (%s) compile log: %s\n", fileName, prefix, output);
+    }
+    glAttachShader(program, shader);
+    glDeleteShader(shader); // freed with the program
+    return ok == GL_TRUE;
+}
+
+static GLuint linkProgram(GLuint program, bool compiled)
+{
+    GLint ok = GL_FALSE;
+    if (compiled)
+    {
+        glLinkProgram(program);
+        glGetProgramiv(program, GL_LINK_STATUS, &ok);
+        if (!ok)
+        {
+            char output[1024] = {0};
+            glGetProgramInfoLog(program, sizeof(output), NULL, output);
+            printf("GPU board link log: %s\n", output);
+        }
+    }
+    if (!ok)
+    {
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+static GLuint computeProgram(const char* pass)
+{
+    std::string prefix = std::string("#version 430\n#define ") + pass + "\n";
+    GLuint program = glCreateProgram();
+    return linkProgram(program, attachShader(program, GL_COMPUTE_SHADER, "comp_board.glsl", prefix.c_str()));
+}
+
+// The xorshift step of Rng::next() without the output multiply. It is
+// linear over bits, which is what makes skipping ahead possible.
+static uint64_t xorshift(uint64_t s)
+{
+    s ^= s >> 12;
+    s ^= s << 25;
+    s ^= s >> 27;
+    return s;
+}
+
+// Applies a linear map given by the images of the 64 state bits.
+static uint64_t applyJump(const uint64_t* columns, uint64_t s)
+{
+    uint64_t result = 0;
+    for (int b = 0; b < 64; b++)
+        if ((s >> b) & 1)
+            result ^= columns[b];
+    return result;
+}
+
+GpuBoard::GpuBoard()
+    : mRows(0), mCols(0), mPasses(32), mControl(0), mMark(0), mCollapse(0), mScan(0), mRefill(0), mDraw(0), mCells(0), mFlags(0),
+      mColumns(0), mState(0), mJumps(0), mCellTexture(0), mOrthoLoc(-1), mColorsLoc(-1), mPointSizeLoc(-1),
+      mReadbacksIssued(0), mReadbacksDone(0), mClickHead(0), mValidate(false), mCpuMoves(0), mCpuScore(0),
+      mCheckedMoves(0), mValidated(0), mMismatches(0)
+{
+    std::fill(mReadbacks, mReadbacks + NUM_READBACKS, 0);
+    std::fill(mFences, mFences + NUM_READBACKS, (GLsync) 0);
+    memset(&mShown, 0, sizeof(mShown));
+}
+
+bool GpuBoard::supported()
+{
+    return GLEW_VERSION_4_3;
+}
+
+bool GpuBoard::init(const uint8_t* cells, int rows, int cols, const Rng& rng, bool validate)
+{
+    static_assert(offsetof(State, rng) == 32 && offsetof(State, dispatch) == 64 && offsetof(State, clicks) == 128,
+                  "State must match the std430 layout in comp_board.glsl");
+
+    GLint maxTexels = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+    if ((int64_t) rows * cols > maxTexels)
+    {
+        printf("GPU board: %dx%d is more than %d cells\n", cols, rows, maxTexels);
+        return false;
+    }
+
+    mControl = computeProgram("CONTROL");
+    mMark = computeProgram("MARK");
+    mCollapse = computeProgram("COLLAPSE");
+    mScan = computeProgram("SCAN");
+    mRefill = computeProgram("REFILL");
+    mDraw = glCreateProgram();
+    bool compiled = attachShader(mDraw, GL_VERTEX_SHADER, "vert_board.glsl", "");
+    compiled = attachShader(mDraw, GL_FRAGMENT_SHADER, "frag_board.glsl", "") && compiled;
+    mDraw = linkProgram(mDraw, compiled);
+    if (!mControl || !mMark || !mCollapse || !mScan || !mRefill || !mDraw)
+    {
+        release();
+        return false;
+    }
+
+    mRows = rows;
+    mCols = cols;
+
+    GLuint programs[] = {mControl, mMark, mCollapse, mScan, mRefill, mDraw};
+    for (GLuint program : programs)
+    {
+        glUseProgram(program);
+        glUniform2i(glGetUniformLocation(program, "size"), rows, cols);
+    }
+
+    // one thread per cell in groups of 256, spread over y past the limit
+    // on x; the mark pass skips the extra threads
+    GLuint groups = ((GLuint) rows * cols + 255) / 256;
+    GLuint groupsX = std::min<GLuint>(groups, 65535);
+    glUseProgram(mControl);
+    glUniform3ui(glGetUniformLocation(mControl, "cellGroups"), groupsX, (groups + groupsX - 1) / groupsX, 1);
+    glUniform3ui(glGetUniformLocation(mControl, "columnGroups"), (cols + 63) / 64, 1, 1);
+
+    glUseProgram(mDraw);
+    glUniform1i(glGetUniformLocation(mDraw, "cells"), 0);
+    mOrthoLoc = glGetUniformLocation(mDraw, "orthoMat");
+    mColorsLoc = glGetUniformLocation(mDraw, "colors");
+    mPointSizeLoc = glGetUniformLocation(mDraw, "pointSize");
+    glUseProgram(0);
+
+    // xorshift^(2^k) for every k, as the images of the state bits
+    std::vector<uint64_t> jumps(JUMP_LEVELS * 64);
+    for (int b = 0; b < 64; b++)
+        jumps[b] = xorshift(1ull << b);
+    for (int k = 1; k < JUMP_LEVELS; k++)
+        for (int b = 0; b < 64; b++)
+            jumps[k * 64 + b] = applyJump(&jumps[(k - 1) * 64], jumps[(k - 1) * 64 + b]);
+
+    GLuint buffers[5];
+    glGenBuffers(5, buffers);
+    mCells = buffers[0];
+    mFlags = buffers[1];
+    mColumns = buffers[2];
+    mState = buffers[3];
+    mJumps = buffers[4];
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, mCells);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, (size_t) rows * cols * 4, NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, mFlags);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, (size_t) rows * cols * 4, NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, mColumns);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, (size_t) cols * 8, NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, mState);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(State), NULL, GL_DYNAMIC_DRAW);
+    // the uint64_t words are already low word first on little-endian hosts
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, mJumps);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, jumps.size() * 8, &jumps[0], GL_STATIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    glGenTextures(1, &mCellTexture);
+    glBindTexture(GL_TEXTURE_BUFFER, mCellTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, mCells);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+    glGenBuffers(NUM_READBACKS, mReadbacks);
+    for (int i = 0; i < NUM_READBACKS; i++)
+    {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, mReadbacks[i]);
+        glBufferData(GL_COPY_WRITE_BUFFER, offsetof(State, dispatch), NULL, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    mValidate = validate;
+    reset(cells, rng);
+    return true;
+}
+
+void GpuBoard::release()
+{
+    GLuint programs[] = {mControl, mMark, mCollapse, mScan, mRefill, mDraw};
+    for (GLuint program : programs)
+        if (program)
+            glDeleteProgram(program);
+    mControl = mMark = mCollapse = mScan = mRefill = mDraw = 0;
+
+    if (enabled())
+    {
+        GLuint buffers[5] = {mCells, mFlags, mColumns, mState, mJumps};
+        glDeleteBuffers(5, buffers);
+        glDeleteTextures(1, &mCellTexture);
+        for (int i = 0; i < NUM_READBACKS; i++)
+            if (mFences[i])
+                glDeleteSync(mFences[i]);
+        glDeleteBuffers(NUM_READBACKS, mReadbacks);
+    }
+    mRows = mCols = 0;
+}
+
+void GpuBoard::reset(const uint8_t* cells, const Rng& rng)
+{
+    upload(cells, rng);
+
+    // readbacks still in flight describe the old board
+    for (int i = 0; i < NUM_READBACKS; i++)
+    {
+        if (mFences[i])
+            glDeleteSync(mFences[i]);
+        mFences[i] = 0;
+    }
+    mReadbacksIssued = mReadbacksDone = 0;
+    memset(&mShown, 0, sizeof(mShown));
+    mClickHead = 0;
+
+    if (mValidate)
+    {
+        mCpuCells.assign(cells, cells + mRows * mCols);
+        mCpuMatched.assign(mRows * mCols, 0);
+        mCpuRng = rng;
+        mCpuMoves = mCpuScore = mCheckedMoves = 0;
+    }
+}
+
+void GpuBoard::upload(const uint8_t* cells, const Rng& rng)
+{
+    std::vector<uint32_t> words(cells, cells + mRows * mCols);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, mCells);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, words.size() * 4, &words[0]);
+
+    State state;
+    memset(&state, 0, sizeof(state));
+    state.phase = PHASE_IDLE;
+    state.rng[0] = (uint32_t) rng.state;
+    state.rng[1] = (uint32_t) (rng.state >> 32);
+    for (int i = 0; i < 4; i++)
+        state.dispatch[i][1] = state.dispatch[i][2] = 1; // empty until the control pass fills them
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, mState);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(state), &state);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+bool GpuBoard::click(int row, int col)
+{
+    if (!enabled() || row < 0 || row >= mRows || col < 0 || col >= mCols)
+        return false;
+    if (mClickHead - mShown.clickTail >= (uint32_t) MAX_CLICKS)
+        return false;
+
+    // the GPU only writes clickTail, so these words can be updated while
+    // passes are queued
+    uint32_t click[2] = {(uint32_t) row, (uint32_t) col};
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, mState);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, offsetof(State, clicks) + (mClickHead % MAX_CLICKS) * sizeof(click),
+                    sizeof(click), click);
+    mClickHead++;
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, offsetof(State, clickHead), 4, &mClickHead);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    if (mValidate)
+    {
+        MoveResult result = playMove(&mCpuCells[0], &mCpuMatched[0], mRows, mCols, row, col, mCpuRng);
+        mCpuMoves++;
+        mCpuScore += result.score;
+    }
+    return true;
+}
+
+void GpuBoard::update()
+{
+    if (!enabled())
+        return;
+    TRACE_ZONE("gpuBoard");
+    pollReadbacks();
+
+    // nothing to do until the next click once the GPU reported it is idle
+    if (!busy())
+        return;
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, mCells);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, mFlags);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, mColumns);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, mState);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, mJumps);
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, mState);
+
+    // passes the control pass did not ask for are dispatched empty
+    GLuint passes[4] = {mMark, mCollapse, mScan, mRefill};
+    for (int p = 0; p < mPasses; p++)
+    {
+        glUseProgram(mControl);
+        glDispatchCompute(1, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+        for (int i = 0; i < 4; i++)
+        {
+            glUseProgram(passes[i]);
+            glDispatchComputeIndirect(offsetof(State, dispatch) + i * sizeof(uint32_t[4]));
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        }
+    }
+    glUseProgram(0);
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+
+    // copy the counters out; they are read once the copy has finished
+    if (mReadbacksIssued - mReadbacksDone < NUM_READBACKS)
+    {
+        int slot = mReadbacksIssued % NUM_READBACKS;
+        glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+        glBindBuffer(GL_COPY_READ_BUFFER, mState);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, mReadbacks[slot]);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, offsetof(State, dispatch));
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        mFences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush(); // or the fence may never be reached without a swap
+        mReadbacksIssued++;
+    }
+}
+
+void GpuBoard::pollReadbacks()
+{
+    while (mReadbacksDone < mReadbacksIssued)
+    {
+        int slot = mReadbacksDone % NUM_READBACKS;
+        GLenum status = glClientWaitSync(mFences[slot], 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            break;
+        glDeleteSync(mFences[slot]);
+        mFences[slot] = 0;
+
+        glBindBuffer(GL_COPY_READ_BUFFER, mReadbacks[slot]);
+        glGetBufferSubData(GL_COPY_READ_BUFFER, 0, offsetof(State, dispatch), &mShown);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        mReadbacksDone++;
+    }
+
+    if (mValidate && !busy() && (int) mShown.moves == mCpuMoves && mCheckedMoves != mCpuMoves)
+        validate();
+}
+
+void GpuBoard::validate()
+{
+    TRACE_ZONE("validate");
+    std::vector<uint8_t> cells;
+    uint64_t rngState;
+    download(cells, rngState);
+    mCheckedMoves = mCpuMoves;
+
+    int differing = 0, first = -1;
+    for (size_t k = 0; k < cells.size(); k++)
+    {
+        if (cells[k] != mCpuCells[k])
+        {
+            if (first < 0)
+                first = k;
+            differing++;
+        }
+    }
+
+    if (differing == 0 && rngState == mCpuRng.state && (int) mShown.score == mCpuScore)
+    {
+        mValidated++;
+        return;
+    }
+    mMismatches++;
+    printf("GPU board differs from the CPU after %d moves: %d cells", mCpuMoves, differing);
+    if (first >= 0)
+        printf(" (first at row %d, col %d)", first / mCols, first % mCols);
+    printf(", score %d vs %d, rng %s\n", (int) mShown.score, mCpuScore, rngState == mCpuRng.state ? "equal" : "differs");
+
+    // continue from the GPU's board so later moves are compared on their own
+    mCpuCells = cells;
+    mCpuRng.state = rngState;
+    mCpuScore = mShown.score;
+}
+
+void GpuBoard::download(std::vector<uint8_t>& cells, uint64_t& rngState)
+{
+    std::vector<uint32_t> words(mRows * mCols);
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, mCells);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, words.size() * 4, &words[0]);
+    uint32_t rng[2];
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, mState);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, offsetof(State, rng), sizeof(rng), rng);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    cells.assign(words.begin(), words.end());
+    rngState = rng[0] | (uint64_t) rng[1] << 32;
+}
+
+void GpuBoard::draw(const float* orthoMat, const float* colors, float pointSize)
+{
+    if (!enabled())
+        return;
+
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+    glUseProgram(mDraw);
+    glUniformMatrix4fv(mOrthoLoc, 1, GL_FALSE, orthoMat);
+    glUniform3fv(mColorsLoc, NUM_COLORS, colors);
+    glUniform1f(mPointSizeLoc, pointSize);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_BUFFER, mCellTexture);
+    glDrawArrays(GL_POINTS, 0, mRows * mCols);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+size_t GpuBoard::gpuBytes() const
+{
+    if (!enabled())
+        return 0;
+    return (size_t) mRows * mCols * 8 + mCols * 8 + sizeof(State) + JUMP_LEVELS * 64 * 8 +
+           NUM_READBACKS * offsetof(State, dispatch);
+}
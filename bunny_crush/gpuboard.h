@@ -0,0 +1,127 @@
+#ifndef GPUBOARD_H
+#define GPUBOARD_H
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include <GL/glew.h>
+#include "board.h"
+
+// A board played by compute shaders (GL 4.3), for boards with millions of
+// cells. The cells live in a shader storage buffer that the rules update
+// in place and the renderer reads as a texture buffer, so they never
+// travel to the CPU and back.
+//
+// The rules are the ones in board.h, applied like playMove(): a click pops
+// its tile, then runs are marked and removed and columns compacted and
+// refilled until the board is stable. A control shader steps through that
+// cascade one pass at a time and sizes the next passes' indirect
+// dispatches, so the CPU only issues a fixed number of passes per frame
+// and never waits. The score and move count come back asynchronously, a
+// few frames late.
+//
+// Matching follows markMatches() exactly, including a tile that is
+// already marked by an earlier run in scan order starting no new run.
+// Whether a tile is covered by a vertical run depends only on tiles above
+// it and whether it is covered by a horizontal run only on tiles to its
+// left, so the coverage is the unique fixed point of those rules. It is
+// found by iterating them until nothing changes, usually in one pass.
+// Refills draw from the board's Rng in the same order as the CPU: each
+// column skips ahead by the tiles refilled in the columns before it,
+// using precomputed powers of the xorshift step.
+
+class GpuBoard
+{
+public:
+    static const int MAX_CLICKS = 64; // clicks waiting on the GPU
+
+    GpuBoard();
+
+    /// True if the context has compute shaders and storage buffers.
+    static bool supported();
+
+    /// Compiles the shaders and uploads a rows x cols board and the state
+    /// of the Rng that continues it. With `validate`, every move is also
+    /// played on the CPU and the boards are compared once the GPU is done
+    /// with it. Returns false if a shader does not build.
+    bool init(const uint8_t* cells, int rows, int cols, const Rng& rng, bool validate);
+    void release();
+
+    /// Replaces the board, e.g. to start a new game. Pending clicks are
+    /// dropped.
+    void reset(const uint8_t* cells, const Rng& rng);
+
+    bool enabled() const { return mRows > 0; }
+    int rows() const { return mRows; }
+    int cols() const { return mCols; }
+
+    /// Queues a click. Returns false if too many are still waiting.
+    bool click(int row, int col);
+
+    /// Issues this frame's passes and picks up finished readbacks. Call
+    /// once per frame.
+    void update();
+
+    /// Passes issued per frame while a move is resolved (default 32). A
+    /// pass marks runs once or removes them once, so a cascade round
+    /// usually takes two.
+    void setPassesPerFrame(int passes) { mPasses = std::max(1, passes); }
+
+    /// Draws every cell as a square point of `pointSize` pixels into the
+    /// -10..10 view, in the tiles' colors.
+    void draw(const float* orthoMat, const float* colors, float pointSize);
+
+    /// As of the latest readback.
+    int moves() const { return mShown.moves; }
+    int score() const { return mShown.score; }
+    bool busy() const { return mShown.phase != 0 || mShown.clickTail != mClickHead; }
+
+    /// Reads the whole board back, waiting for the GPU. For validation.
+    void download(std::vector<uint8_t>& cells, uint64_t& rngState);
+
+    /// Validation results so far.
+    int validated() const { return mValidated; }
+    int mismatches() const { return mMismatches; }
+
+    size_t gpuBytes() const;
+
+private:
+    // Mirrors the State block of comp_board.glsl
+    struct State
+    {
+        uint32_t phase, iteration, changed, marked, roundScore, score, moves, removedTotal;
+        uint32_t rng[2]; // low, high word
+        uint32_t clickHead, clickTail, cascades, pad[3];
+        uint32_t dispatch[4][4]; // indirect arguments of the mark, collapse, scan and refill passes
+        uint32_t clicks[MAX_CLICKS][2];
+    };
+
+    static const int NUM_READBACKS = 3;
+
+    void upload(const uint8_t* cells, const Rng& rng);
+    void pollReadbacks();
+    void validate();
+
+    int mRows, mCols;
+    int mPasses;
+    GLuint mControl, mMark, mCollapse, mScan, mRefill, mDraw;
+    GLuint mCells, mFlags, mColumns, mState, mJumps;
+    GLuint mCellTexture;
+    GLint mOrthoLoc, mColorsLoc, mPointSizeLoc;
+
+    GLuint mReadbacks[NUM_READBACKS];
+    GLsync mFences[NUM_READBACKS];
+    int mReadbacksIssued, mReadbacksDone;
+    State mShown;
+    uint32_t mClickHead; // clicks queued so far
+
+    // validation
+    bool mValidate;
+    std::vector<uint8_t> mCpuCells, mCpuMatched;
+    Rng mCpuRng;
+    int mCpuMoves, mCpuScore;
+    int mCheckedMoves; // the CPU board was last compared after this many moves
+    int mValidated, mMismatches;
+};
+
+#endif
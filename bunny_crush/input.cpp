@@ -0,0 +1,57 @@
+#include <cstring>
+#include "input.h"
+
+void InputBuffer::offer(const InputEvent& click)
+{
+    switch (policy)
+    {
+    case INPUT_QUEUE:
+        if (mPending.size() < MAX_PENDING)
+            mPending.push_back(click);
+        break;
+
+    case INPUT_COALESCE:
+        mPending.clear();
+        mPending.push_back(click);
+        break;
+
+    case INPUT_SELECT:
+    {
+        bool sameTile = !mPending.empty() && mPending.back().row == click.row && mPending.back().col == click.col;
+        mPending.clear();
+        if (!sameTile)
+            mPending.push_back(click);
+        break;
+    }
+    }
+}
+
+bool InputBuffer::next(int64_t nowUs, InputEvent& click)
+{
+    while (!mPending.empty())
+    {
+        click = mPending.front();
+        mPending.pop_front();
+        if (nowUs - click.timeUs <= MAX_AGE_US)
+            return true;
+    }
+    return false;
+}
+
+bool InputBuffer::selected(int& row, int& col) const
+{
+    if (policy != INPUT_SELECT || mPending.empty())
+        return false;
+    row = mPending.back().row;
+    col = mPending.back().col;
+    return true;
+}
+
+InputPolicy parseInputPolicy(const char* name)
+{
+    if (name && strcmp(name, "coalesce") == 0)
+        return INPUT_COALESCE;
+    if (name && strcmp(name, "select") == 0)
+        return INPUT_SELECT;
+    return INPUT_QUEUE;
+}
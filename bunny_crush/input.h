@@ -0,0 +1,115 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+
+// Player input between the GLFW callbacks and the simulation thread.
+//
+// The callbacks timestamp each event and push it into an InputQueue. The
+// simulation thread drains the queue at the start of every tick into an
+// InputBuffer, which decides by policy which clicks are kept while the
+// board is still animating, and hands them to the game once it is idle.
+
+enum InputType
+{
+    INPUT_CLICK,
+    INPUT_RESET,
+};
+
+enum InputPolicy
+{
+    INPUT_QUEUE,    // keep every click and play them in order
+    INPUT_COALESCE, // keep only the newest click
+    INPUT_SELECT,   // like coalesce, but the pending tile is shown as
+                    // selected and clicking it again cancels it
+};
+
+struct InputEvent
+{
+    int64_t timeUs; // inputTimeUs() when the event happened
+    int type;       // InputType
+    int row, col;
+    int board;      // which board of a split screen the click is on
+};
+
+inline int64_t inputTimeUs()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// Lock-free single-producer / single-consumer queue. push() is called from
+/// the GLFW callbacks, pop() from the simulation thread.
+class InputQueue
+{
+public:
+    static const uint32_t CAPACITY = 64; // must be a power of two
+
+    InputQueue() : mHead(0), mTail(0) { }
+
+    /// Returns false if the queue is full and the event was dropped.
+    bool push(const InputEvent& event)
+    {
+        uint32_t head = mHead.load(std::memory_order_relaxed);
+        if (head - mTail.load(std::memory_order_acquire) == CAPACITY)
+            return false;
+        mEvents[head & (CAPACITY - 1)] = event;
+        mHead.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// Consumer side, like pop().
+    bool empty() const
+    {
+        return mTail.load(std::memory_order_relaxed) == mHead.load(std::memory_order_acquire);
+    }
+
+    bool pop(InputEvent& event)
+    {
+        uint32_t tail = mTail.load(std::memory_order_relaxed);
+        if (tail == mHead.load(std::memory_order_acquire))
+            return false;
+        event = mEvents[tail & (CAPACITY - 1)];
+        mTail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    alignas(64) std::atomic<uint32_t> mHead;
+    alignas(64) std::atomic<uint32_t> mTail;
+    InputEvent mEvents[CAPACITY];
+};
+
+/// Clicks waiting for the board to settle. Owned by the simulation thread.
+class InputBuffer
+{
+public:
+    static const int MAX_PENDING = 8;            // INPUT_QUEUE drops newer clicks beyond this
+    static const int64_t MAX_AGE_US = 3000000;   // clicks older than this are stale
+
+    InputBuffer() : policy(INPUT_QUEUE) { }
+
+    void offer(const InputEvent& click);
+
+    /// Oldest pending click that is not stale, if any.
+    bool next(int64_t nowUs, InputEvent& click);
+
+    void clear() { mPending.clear(); }
+    int pending() const { return mPending.size(); }
+
+    /// The tile shown as selected under INPUT_SELECT.
+    bool selected(int& row, int& col) const;
+
+    InputPolicy policy;
+
+private:
+    std::deque<InputEvent> mPending;
+};
+
+/// Parses "queue", "coalesce" or "select"; anything else gives INPUT_QUEUE.
+InputPolicy parseInputPolicy(const char* name);
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+/// Input-to-display latencies in 0.1 ms buckets. Adding a sample is O(1),
+/// so it can stay on for a whole session; percentiles are read from the
+/// bucket counts.
+class LatencyHistogram
+{
+public:
+    static const int BUCKET_US = 100;
+    static const int NUM_BUCKETS = 5000; // up to 0.5 s; longer ones land in the last bucket
+
+    LatencyHistogram() : mCount(0), mMaxUs(0) { std::fill(mBuckets, mBuckets + NUM_BUCKETS, 0); }
+
+    void add(int64_t us)
+    {
+        us = std::max<int64_t>(us, 0);
+        mBuckets[std::min<int64_t>(us / BUCKET_US, NUM_BUCKETS - 1)]++;
+        mCount++;
+        mMaxUs = std::max(mMaxUs, us);
+    }
+
+    uint64_t count() const { return mCount; }
+    double maxMs() const { return mMaxUs * 1e-3; }
+
+    /// Upper edge of the bucket holding the p-th fraction of the samples,
+    /// 0 without samples.
+    double percentileMs(double p) const
+    {
+        uint64_t target = (uint64_t) (p * mCount);
+        uint64_t seen = 0;
+        for (int i = 0; i < NUM_BUCKETS; i++)
+        {
+            seen += mBuckets[i];
+            if (seen > target)
+                return (i + 1) * BUCKET_US * 1e-3;
+        }
+        return mCount ? maxMs() : 0;
+    }
+
+private:
+    uint32_t mBuckets[NUM_BUCKETS];
+    uint64_t mCount;
+    int64_t mMaxUs;
+};
+
+/// Caps the frame rate by sleeping until each frame is due. A frame more
+/// than one period late restarts the schedule rather than rushing the
+/// following frames to catch up.
+class FramePacer
+{
+public:
+    FramePacer() : mPeriod(0), mStarted(false) { }
+
+    /// 0 disables the cap.
+    void setRate(double fps)
+    {
+        mPeriod = fps > 0 ? std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                std::chrono::duration<double>(1.0 / fps))
+                          : std::chrono::steady_clock::duration(0);
+        mStarted = false;
+    }
+    bool enabled() const { return mPeriod.count() > 0; }
+
+    void wait()
+    {
+        if (!enabled())
+            return;
+
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (!mStarted)
+        {
+            mNext = now;
+            mStarted = true;
+            return;
+        }
+
+        mNext += mPeriod;
+        if (now - mNext > mPeriod)
+            mNext = now;
+        else
+            std::this_thread::sleep_until(mNext);
+    }
+
+private:
+    std::chrono::steady_clock::duration mPeriod;
+    std::chrono::steady_clock::time_point mNext;
+    bool mStarted;
+};
+
+#endif
@@ -1,9 +1,16 @@
 #include <cstdio>
 #include <cassert>
+#include <cstddef>
 #include <cstdlib>
 #include <cstring>
+#include <ctime>
 #include <string>
 #include <map>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
 #include <fstream>
 #include <iostream>
 #include <sstream>
@@ -16,6 +23,21 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <ft2build.h>
 #include FT_FREETYPE_H
+#include "board.h"
+#include "capture.h"
+#include "game.h"
+#include "gpuboard.h"
+#include "input.h"
+#include "latency.h"
+#include "objloader.h"
+#include "particles.h"
+#include "savestate.h"
+#include "spectator.h"
+#include "resolution.h"
+#include "triplebuffer.h"
+#include "telemetry.h"
+#include "trace.h"
+#include "transform.h"
 
 
 #define BUFFER_OFFSET(i) ((char*)NULL + (i))
@@ -25,69 +47,34 @@ using namespace std;
 //GLuint gProgram[3];
 GLuint gProgram[6];
 GLint gIntensityLoc;
+GLint gKdLoc, gModelingMatLoc, gModelingMatInvTrLoc, gOrthoMatLoc, gRegionLoc;
+GLint gTilesOrthoMatLoc;
 float gIntensity = 1000;
 int gWidth = 640, gHeight = 600;
+int gTextWidth, gTextHeight; // extent of the text projection
 
-struct Vertex
-{
-    Vertex(GLfloat inX, GLfloat inY, GLfloat inZ) : x(inX), y(inY), z(inZ) { }
-    GLfloat x, y, z;
-};
+// Parsed OBJ data. It is only needed until initVBO() has uploaded it, so
+// it lives in an arena that is freed in one go afterwards.
+ObjData gObj;
+size_t gLoadPeakBytes; // for the memory report
 
-struct Texture
+/// Location of one OBJ file inside the shared vertex/index buffers
+struct Mesh
 {
-    Texture(GLfloat inU, GLfloat inV) : u(inU), v(inV) { }
-    GLfloat u, v;
+    GLint baseVertex;   // first vertex of this mesh in gVertexAttribBuffer
+    GLuint firstIndex;  // first index of this mesh in gIndexBuffer
+    GLsizei indexCount; // number of indices to draw
 };
 
-struct Normal
-{
-    Normal(GLfloat inX, GLfloat inY, GLfloat inZ) : x(inX), y(inY), z(inZ) { }
-    GLfloat x, y, z;
-};
+vector<Mesh> gMeshes;
+bool gHasBaseVertex = false;
+float gModelRadius = 0; // farthest vertex from its model's origin
 
-struct Face
-{
-	Face(int v[], int t[], int n[]) {
-		vIndex[0] = v[0];
-		vIndex[1] = v[1];
-		vIndex[2] = v[2];
-		tIndex[0] = t[0];
-		tIndex[1] = t[1];
-		tIndex[2] = t[2];
-		nIndex[0] = n[0];
-		nIndex[1] = n[1];
-		nIndex[2] = n[2];
-	}
-    GLuint vIndex[3], tIndex[3], nIndex[3];
-};
-
-struct Object
-{
-  Object() {
-    color = glm::vec3(1, 0, 0);
-    isPopped = 0;
-    willSlide = 0;
-    isPressed = 0;
-    isMatched = 0;
-    ySlide = 0;
-  }
-  glm::vec3 color;
-  bool isPopped;
-  bool willSlide;
-  bool isPressed;
-  bool isMatched;
-  int ySlide;
-};
-
-vector<Vertex> gVertices;
-vector<Texture> gTextures;
-vector<Normal> gNormals;
-vector<Face> gFaces;
+glm::vec3 gColors[NUM_COLORS] = {glm::vec3(0, 0.8, 0.8), glm::vec3(1, 0.5, 0), glm::vec3(0, 0, 0.8), glm::vec3(1, 0, 0), glm::vec3(0.4, 0, 0.8)};
 
 GLuint gVertexAttribBuffer, gTextVBO, gIndexBuffer;
 GLint gInVertexLoc, gInNormalLoc;
-int gVertexDataSizeInBytes, gNormalDataSizeInBytes;
+int gVertexDataSizeInBytes, gNormalDataSizeInBytes, gIndexDataSizeInBytes;
 
 /// Holds all state information relevant to a character as loaded using FreeType
 struct Character {
@@ -102,97 +89,21 @@ std::map<GLchar, Character> Characters;
 
 bool ParseObj(const string& fileName)
 {
-    fstream myfile;
-
-    // Open the input
-    myfile.open(fileName.c_str(), std::ios::in);
-
-    if (myfile.is_open())
-    {
-        string curLine;
-
-        while (getline(myfile, curLine))
-        {
-            stringstream str(curLine);
-            GLfloat c1, c2, c3;
-            GLuint index[9];
-            string tmp;
-
-            if (curLine.length() >= 2)
-            {
-                if (curLine[0] == '#') // comment
-                {
-                    continue;
-                }
-                else if (curLine[0] == 'v')
-                {
-                    if (curLine[1] == 't') // texture
-                    {
-                        str >> tmp; // consume "vt"
-                        str >> c1 >> c2;
-                        gTextures.push_back(Texture(c1, c2));
-                    }
-                    else if (curLine[1] == 'n') // normal
-                    {
-                        str >> tmp; // consume "vn"
-                        str >> c1 >> c2 >> c3;
-                        gNormals.push_back(Normal(c1, c2, c3));
-                    }
-                    else // vertex
-                    {
-                        str >> tmp; // consume "v"
-                        str >> c1 >> c2 >> c3;
-                        gVertices.push_back(Vertex(c1, c2, c3));
-                    }
-                }
-                else if (curLine[0] == 'f') // face
-                {
-                    str >> tmp; // consume "f"
-					char c;
-					int vIndex[3],  nIndex[3], tIndex[3];
-					str >> vIndex[0]; str >> c >> c; // consume "//"
-					str >> nIndex[0];
-					str >> vIndex[1]; str >> c >> c; // consume "//"
-					str >> nIndex[1];
-					str >> vIndex[2]; str >> c >> c; // consume "//"
-					str >> nIndex[2];
-
-					assert(vIndex[0] == nIndex[0] &&
-						   vIndex[1] == nIndex[1] &&
-						   vIndex[2] == nIndex[2]); // a limitation for now
-
-					// make indices start from 0
-					for (int c = 0; c < 3; ++c)
-					{
-						vIndex[c] -= 1;
-						nIndex[c] -= 1;
-						tIndex[c] -= 1;
-					}
-
-                    gFaces.push_back(Face(vIndex, tIndex, nIndex));
-                }
-                else
-                {
-                    cout << "Ignoring unidentified line in obj file: " << curLine << endl;
-                }
-            }
+    TRACE_ZONE("ParseObj");
+    Mesh mesh;
+    mesh.baseVertex = gObj.vertices.size();
+    mesh.firstIndex = gObj.indices.size();
 
-            //data += curLine;
-            if (!myfile.eof())
-            {
-                //data += "\n";
-            }
-        }
-
-        myfile.close();
-    }
-    else
+    if (!parseObj(fileName, gObj))
     {
         return false;
     }
 
+    mesh.indexCount = gObj.indices.size() - mesh.firstIndex;
+    gMeshes.push_back(mesh);
 
-	assert(gVertices.size() == gNormals.size());
+    cout << fileName << ": " << mesh.indexCount / 3 << " triangles, "
+         << gObj.vertices.size() - mesh.baseVertex << " vertices" << endl;
 
     return true;
 }
@@ -279,6 +190,7 @@ void createFS(GLuint& program, const string& filename)
 
 void initShaders()
 {
+    TRACE_ZONE("initShaders");
     gProgram[0] = glCreateProgram();
 
     gProgram[5] = glCreateProgram();
@@ -288,6 +200,18 @@ void initShaders()
 
 
 
+    gProgram[1] = glCreateProgram();
+    createVS(gProgram[1], "vert_particle.glsl");
+    createFS(gProgram[1], "frag_particle.glsl");
+
+    gProgram[2] = glCreateProgram();
+    createVS(gProgram[2], "vert_tiles.glsl");
+    createFS(gProgram[2], "frag0.glsl");
+
+    gProgram[3] = glCreateProgram();
+    createVS(gProgram[3], "vert_impostor.glsl");
+    createFS(gProgram[3], "frag_impostor.glsl");
+
     createVS(gProgram[5], "vert_text.glsl");
     createFS(gProgram[5], "frag_text.glsl");
 
@@ -296,18 +220,45 @@ void initShaders()
 
     glBindAttribLocation(gProgram[5], 2, "vertex");
 
+    glBindAttribLocation(gProgram[1], 3, "inX");
+    glBindAttribLocation(gProgram[1], 4, "inY");
+    glBindAttribLocation(gProgram[1], 5, "inLife");
+    glBindAttribLocation(gProgram[1], 6, "inColor");
+
+    glBindAttribLocation(gProgram[2], 0, "inVertex");
+    glBindAttribLocation(gProgram[2], 1, "inNormal");
+    glBindAttribLocation(gProgram[2], 7, "inModelingMat"); // 7 to 10
+    glBindAttribLocation(gProgram[2], 11, "inKd");
+    glBindAttribLocation(gProgram[2], 12, "inRegion");
+
+    glBindAttribLocation(gProgram[3], 13, "inPoint");
+    glBindAttribLocation(gProgram[3], 14, "inCell");
+
     glLinkProgram(gProgram[0]);
 
+    glLinkProgram(gProgram[1]);
+    glLinkProgram(gProgram[2]);
+    glLinkProgram(gProgram[3]);
     glLinkProgram(gProgram[5]);
     glUseProgram(gProgram[0]);
 
     gIntensityLoc = glGetUniformLocation(gProgram[0], "intensity");
-    cout << "gIntensityLoc = " << gIntensityLoc << endl;
     glUniform1f(gIntensityLoc, gIntensity);
+
+    gKdLoc = glGetUniformLocation(gProgram[0], "kd");
+    gModelingMatLoc = glGetUniformLocation(gProgram[0], "modelingMat");
+    gModelingMatInvTrLoc = glGetUniformLocation(gProgram[0], "modelingMatInvTr");
+    gOrthoMatLoc = glGetUniformLocation(gProgram[0], "orthoMat");
+    gRegionLoc = glGetUniformLocation(gProgram[0], "region");
+
+    glUseProgram(gProgram[2]);
+    glUniform1f(glGetUniformLocation(gProgram[2], "intensity"), gIntensity);
+    gTilesOrthoMatLoc = glGetUniformLocation(gProgram[2], "orthoMat");
 }
 
 void initVBO()
 {
+    TRACE_ZONE("initVBO");
     glEnableVertexAttribArray(0);
     glEnableVertexAttribArray(1);
     assert(glGetError() == GL_NONE);
@@ -320,75 +271,79 @@ void initVBO()
     glBindBuffer(GL_ARRAY_BUFFER, gVertexAttribBuffer);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gIndexBuffer);
 
-    gVertexDataSizeInBytes = gVertices.size() * 3 * sizeof(GLfloat);
-    gNormalDataSizeInBytes = gNormals.size() * 3 * sizeof(GLfloat);
-    int indexDataSizeInBytes = gFaces.size() * 3 * sizeof(GLuint);
-    GLfloat* vertexData = new GLfloat [gVertices.size() * 3];
-    GLfloat* normalData = new GLfloat [gNormals.size() * 3];
-    GLuint* indexData = new GLuint [gFaces.size() * 3];
-
-    float minX = 1e6, maxX = -1e6;
-    float minY = 1e6, maxY = -1e6;
-    float minZ = 1e6, maxZ = -1e6;
-
-    for (int i = 0; i < gVertices.size(); ++i)
-    {
-        vertexData[3*i] = gVertices[i].x;
-        vertexData[3*i+1] = gVertices[i].y;
-        vertexData[3*i+2] = gVertices[i].z;
+    // positions and normals are uploaded straight from the arena chunks
+    static_assert(sizeof(Vertex) == 3 * sizeof(GLfloat) && sizeof(Normal) == 3 * sizeof(GLfloat), "packed xyz");
 
-        minX = std::min(minX, gVertices[i].x);
-        maxX = std::max(maxX, gVertices[i].x);
-        minY = std::min(minY, gVertices[i].y);
-        maxY = std::max(maxY, gVertices[i].y);
-        minZ = std::min(minZ, gVertices[i].z);
-        maxZ = std::max(maxZ, gVertices[i].z);
-    }
+    gVertexDataSizeInBytes = gObj.vertices.size() * sizeof(Vertex);
+    gNormalDataSizeInBytes = gObj.normals.size() * sizeof(Normal);
+    gIndexDataSizeInBytes = gObj.indices.size() * sizeof(GLuint);
 
-    std::cout << "minX = " << minX << std::endl;
-    std::cout << "maxX = " << maxX << std::endl;
-    std::cout << "minY = " << minY << std::endl;
-    std::cout << "maxY = " << maxY << std::endl;
-    std::cout << "minZ = " << minZ << std::endl;
-    std::cout << "maxZ = " << maxZ << std::endl;
+    glBufferData(GL_ARRAY_BUFFER, gVertexDataSizeInBytes + gNormalDataSizeInBytes, 0, GL_STATIC_DRAW);
 
-    for (int i = 0; i < gNormals.size(); ++i)
+    GLintptr offset = 0;
+    for (size_t c = 0; c < gObj.vertices.numChunks(); ++c)
     {
-        normalData[3*i] = gNormals[i].x;
-        normalData[3*i+1] = gNormals[i].y;
-        normalData[3*i+2] = gNormals[i].z;
+        const Vertex* v = gObj.vertices.chunk(c);
+        size_t n = gObj.vertices.chunkSize(c);
+        for (size_t i = 0; i < n; ++i)
+        {
+            gModelRadius = std::max(gModelRadius, glm::length(glm::vec3(v[i].x, v[i].y, v[i].z)));
+        }
+        glBufferSubData(GL_ARRAY_BUFFER, offset, n * sizeof(Vertex), v);
+        offset += n * sizeof(Vertex);
     }
 
-    for (int i = 0; i < gFaces.size(); ++i)
+    for (size_t c = 0; c < gObj.normals.numChunks(); ++c)
     {
-        indexData[3*i] = gFaces[i].vIndex[0];
-        indexData[3*i+1] = gFaces[i].vIndex[1];
-        indexData[3*i+2] = gFaces[i].vIndex[2];
+        size_t n = gObj.normals.chunkSize(c);
+        glBufferSubData(GL_ARRAY_BUFFER, offset, n * sizeof(Normal), gObj.normals.chunk(c));
+        offset += n * sizeof(Normal);
     }
 
+    // without base vertex support the indices of each mesh must point
+    // directly into the shared vertex array
+    gHasBaseVertex = GLEW_ARB_draw_elements_base_vertex;
 
-    glBufferData(GL_ARRAY_BUFFER, gVertexDataSizeInBytes + gNormalDataSizeInBytes, 0, GL_STATIC_DRAW);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, gVertexDataSizeInBytes, vertexData);
-    glBufferSubData(GL_ARRAY_BUFFER, gVertexDataSizeInBytes, gNormalDataSizeInBytes, normalData);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexDataSizeInBytes, indexData, GL_STATIC_DRAW);
-
-    // done copying; can free now
-    delete[] vertexData;
-    delete[] normalData;
-    delete[] indexData;
+    // indices are uploaded from the arena too, rebased in place if needed
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, gIndexDataSizeInBytes, 0, GL_STATIC_DRAW);
+    size_t mesh = 0;
+    offset = 0;
+    for (size_t c = 0; c < gObj.indices.numChunks(); ++c)
+    {
+        GLuint* indexData = gObj.indices.chunk(c);
+        size_t n = gObj.indices.chunkSize(c);
+        if (!gHasBaseVertex)
+        {
+            for (size_t i = 0; i < n; ++i)
+            {
+                size_t index = c * ArenaList<GLuint>::CHUNK + i;
+                while (index >= gMeshes[mesh].firstIndex + gMeshes[mesh].indexCount)
+                    ++mesh;
+                indexData[i] += gMeshes[mesh].baseVertex;
+            }
+        }
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, offset, n * sizeof(GLuint), indexData);
+        offset += n * sizeof(GLuint);
+    }
 
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
     glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(gVertexDataSizeInBytes));
 
+    // done copying; drawing only needs gMeshes from here on
+    gLoadPeakBytes = gObj.arena.peak();
+    gObj.release();
 }
 
 void initFonts(int windowWidth, int windowHeight)
 {
+    TRACE_ZONE("initFonts");
     // Set OpenGL options
     //glEnable(GL_CULL_FACE);
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
+    gTextWidth = windowWidth;
+    gTextHeight = windowHeight;
     glm::mat4 projection = glm::ortho(0.0f, static_cast<GLfloat>(windowWidth), 0.0f, static_cast<GLfloat>(windowHeight));
     glUseProgram(gProgram[5]);
     glUniformMatrix4fv(glGetUniformLocation(gProgram[5], "projection"), 1, GL_FALSE, glm::value_ptr(projection));
@@ -471,31 +426,181 @@ void initFonts(int windowWidth, int windowHeight)
     glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
-void init(const char *input_file_name)
+// Split screen. BUNNY_BOARDS=<n> plays up to gMaxBoards boards side by
+// side, in one row or two, each in its own region of the window with its
+// own input. Every board is drawn into the full -10..10 view and squeezed
+// into its region in clip space, after lighting, so a board looks the same
+// wherever it is placed.
+const int gMaxBoards = 8;
+int gNumBoards = 1;
+int gLayoutCols = 1, gLayoutRows = 1;
+
+/// Part of the window that shows one board, as fractions of the window
+/// from its bottom left corner. Boards are numbered from the top left.
+struct BoardRegion
 {
+    float x, y, w, h;
+};
+
+void setBoardLayout(int numBoards)
+{
+    gNumBoards = std::max(1, std::min(numBoards, gMaxBoards));
+    gLayoutCols = gNumBoards <= 3 ? gNumBoards : (gNumBoards + 1) / 2;
+    gLayoutRows = gNumBoards <= 3 ? 1 : 2;
+}
+
+BoardRegion boardRegion(int board)
+{
+    BoardRegion r;
+    r.w = 1.f / gLayoutCols;
+    r.h = 1.f / gLayoutRows;
+    r.x = (board % gLayoutCols) * r.w;
+    r.y = 1 - (board / gLayoutCols + 1) * r.h;
+    return r;
+}
+
+/// Offset (xy) and scale (zw) that map clip space onto the board's region,
+/// as the "region" uniform of vert0.glsl expects
+glm::vec4 regionTransform(int board)
+{
+    BoardRegion r = boardRegion(board);
+    return glm::vec4(r.w + 2 * r.x - 1, r.h + 2 * r.y - 1, r.w, r.h);
+}
+
+// Match pop particles. The simulation thread queues a burst for every tile
+// that vanishes; the render thread sprays, moves and draws the particles.
+BurstQueue gBursts[gMaxBoards]; // one per board
+ParticleSystem gParticles;
+GLuint gParticleVBO;
+GLint gParticleOrthoLoc, gParticlePointSizeLoc;
+const float gParticleSize = 6; // pixels at the initial window height
+
+void initParticles()
+{
+    TRACE_ZONE("initParticles");
+    // one region per attribute array, uploaded as they are stored
+    glGenBuffers(1, &gParticleVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, gParticleVBO);
+    glBufferData(GL_ARRAY_BUFFER, ParticleSystem::CAPACITY * (3 * sizeof(float) + 1), NULL, GL_STREAM_DRAW);
+
+    glUseProgram(gProgram[1]);
+    glUniform3fv(glGetUniformLocation(gProgram[1], "colors"), NUM_COLORS, glm::value_ptr(gColors[0]));
+    gParticleOrthoLoc = glGetUniformLocation(gProgram[1], "orthoMat");
+    gParticlePointSizeLoc = glGetUniformLocation(gProgram[1], "pointSize");
+
+    glEnable(GL_VERTEX_PROGRAM_POINT_SIZE);
+    glEnable(GL_POINT_SPRITE); // gl_PointCoord in compatibility contexts
+}
+
+void updateParticles(const std::vector<BoardFrame>& frames, float dt)
+{
+    TRACE_ZONE("updateParticles");
+    for (int b = 0; b < gNumBoards; b++)
+    {
+        float gridX = 20/float(frames[b].cols);
+        float gridY = 19/float(frames[b].rows);
+        glm::vec4 region = regionTransform(b);
+
+        Burst burst;
+        while (gBursts[b].pop(burst))
+        {
+            // same placement as drawTile, moved into the board's region
+            float x = -10.f + burst.col * gridX + gridX/2;
+            float y = 10.f - (burst.row * gridY + gridY/2);
+            gParticles.emit(x * region.z + 10 * region.x, y * region.w + 10 * region.y, burst.colorId);
+        }
+    }
+    gParticles.update(dt);
+}
+
+// All live particles in one draw call, blended additively over the board.
+void drawParticles(const glm::mat4& orthoMat, int viewportHeight)
+{
+    TRACE_ZONE("drawParticles");
+    int count = gParticles.count();
+    if (count == 0)
+        return;
+
+    const int cap = ParticleSystem::CAPACITY;
+    glBindBuffer(GL_ARRAY_BUFFER, gParticleVBO);
+    glBufferData(GL_ARRAY_BUFFER, cap * (3 * sizeof(float) + 1), NULL, GL_STREAM_DRAW); // orphan last frame's data
+    glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(float), gParticles.x());
+    glBufferSubData(GL_ARRAY_BUFFER, cap * sizeof(float), count * sizeof(float), gParticles.y());
+    glBufferSubData(GL_ARRAY_BUFFER, 2 * cap * sizeof(float), count * sizeof(float), gParticles.life());
+    glBufferSubData(GL_ARRAY_BUFFER, 3 * cap * sizeof(float), count, gParticles.color());
+
+    // only the particle attributes may be enabled, or the draw would read
+    // the mesh and text arrays past their ends
+    for (int i = 0; i < 3; i++)
+        glDisableVertexAttribArray(i);
+    for (int i = 3; i < 7; i++)
+        glEnableVertexAttribArray(i);
+    glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, 0, 0);
+    glVertexAttribPointer(4, 1, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(cap * sizeof(float)));
+    glVertexAttribPointer(5, 1, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(2 * cap * sizeof(float)));
+    glVertexAttribPointer(6, 1, GL_UNSIGNED_BYTE, GL_FALSE, 0, BUFFER_OFFSET(3 * cap * sizeof(float)));
+
+    glUseProgram(gProgram[1]);
+    glUniformMatrix4fv(gParticleOrthoLoc, 1, GL_FALSE, glm::value_ptr(orthoMat));
+    glUniform1f(gParticlePointSizeLoc, gParticleSize * viewportHeight / 600.f);
+
+    glDisable(GL_DEPTH_TEST);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+    glDrawArrays(GL_POINTS, 0, count);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glEnable(GL_DEPTH_TEST);
+
+    for (int i = 3; i < 7; i++)
+        glDisableVertexAttribArray(i);
+    for (int i = 0; i < 3; i++)
+        glEnableVertexAttribArray(i);
+}
+
+void init(int numFiles, char **input_file_names)
+{
+  TRACE_ZONE("init");
 	//ParseObj("armadillo.obj");
 	//ParseObj("bunny.obj");
-  ParseObj(input_file_name);
+  for (int i = 0; i < numFiles; i++)
+  {
+    if (!ParseObj(input_file_names[i]))
+    {
+      cout << "Cannot open object file: " << input_file_names[i] << endl;
+      exit(-1);
+    }
+  }
 
     glEnable(GL_DEPTH_TEST);
     initShaders();
     initFonts(gWidth, gHeight);
     initVBO();
+    initParticles();
 }
 
-void drawModel()
+// All meshes live in the same buffers, so this is done once per frame
+// rather than once per tile.
+void bindModels()
 {
 	glBindBuffer(GL_ARRAY_BUFFER, gVertexAttribBuffer);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gIndexBuffer);
 
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
 	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(gVertexDataSizeInBytes));
+}
+
+void drawModel(int colorId)
+{
+	const Mesh& mesh = gMeshes[colorId % gMeshes.size()];
 
-	glDrawElements(GL_TRIANGLES, gFaces.size() * 3, GL_UNSIGNED_INT, 0);
+	if (gHasBaseVertex)
+		glDrawElementsBaseVertex(GL_TRIANGLES, mesh.indexCount, GL_UNSIGNED_INT, BUFFER_OFFSET(mesh.firstIndex * sizeof(GLuint)), mesh.baseVertex);
+	else
+		glDrawElements(GL_TRIANGLES, mesh.indexCount, GL_UNSIGNED_INT, BUFFER_OFFSET(mesh.firstIndex * sizeof(GLuint)));
 }
 
 void renderText(const std::string& text, GLfloat x, GLfloat y, GLfloat scale, glm::vec3 color)
 {
+    TRACE_ZONE("renderText");
     // Activate corresponding render state
     glUseProgram(gProgram[5]);
     glUniform3f(glGetUniformLocation(gProgram[5], "textColor"), color.x, color.y, color.z);
@@ -543,538 +648,952 @@ void renderText(const std::string& text, GLfloat x, GLfloat y, GLfloat scale, gl
     glBindTexture(GL_TEXTURE_2D, 0);
 }
 
-std::vector<std::vector<Object>> bunnies;
-std::vector<Object> newBunnies;
-std::vector<int> toDrop;
 int gridcol, gridrow;
-bool setColor = 0;
-bool setNew = 0;
-int moveCounter = 0;
-int numOfMatched = 0;
 
-void addBunnies(std::vector<Object> &newBunnies, int numOfBuns)
+Telemetry gTelemetry; // enabled by setting BUNNY_TELEMETRY=<log_file>
+
+Autosaver gAutosaver;
+SpectatorServer gSpectators; // enabled by setting BUNNY_SPECTATE=<[host:]port | unix:path>
+const double gAutosaveInterval = 5.0; // seconds
+
+// The board rules and animations run on the simulation thread at a fixed
+// rate. Each tick publishes a BoardFrame per board; the GL thread draws
+// whichever frames are newest and never waits for the simulation.
+Game gGames[gMaxBoards];
+TripleBuffer<std::vector<BoardFrame> > gFrames; // gNumBoards frames each
+std::atomic<bool> gSimRunning(false);
+const double gTickRate = 60.0; // ticks per second; animation speeds are per tick
+
+// Input from the GLFW callbacks is timestamped and queued for the
+// simulation thread, which keeps clicks made during animations according
+// to BUNNY_INPUT=queue|coalesce|select instead of dropping them.
+InputQueue gInput;
+InputBuffer gPendingInputs[gMaxBoards]; // simulation thread only
+int64_t gInputTakenUs = 0; // newest event consumeInput() has taken, simulation thread only
+
+// Low-latency mode (BUNNY_LOW_LATENCY=1): the GL thread polls for input
+// right before it picks the frame to draw rather than after the swap, and
+// every input wakes the simulation thread, which hands it to the boards
+// and publishes new frames at once instead of at the next tick.
+bool gLowLatency = false;
+std::mutex gInputWakeMutex;
+std::condition_variable gInputWake;
+
+void postInput(int type, int board, int row, int col)
 {
-  srand(time(NULL));
-  glm::vec3 colors[] = {glm::vec3(0, 0.8, 0.8), glm::vec3(1, 0.5, 0), glm::vec3(0, 0, 0.8), glm::vec3(1, 0, 0), glm::vec3(0.4, 0, 0.8)};
+  InputEvent event = {inputTimeUs(), type, row, col, board};
+  gInput.push(event); // a full queue drops the event
 
-  int colorId;
-  for (int i = 0; i < numOfBuns; i++)
+  if (gLowLatency)
   {
-      colorId = (rand() % (5));
-      if (setNew)
-      {
-        Object newBunny = Object();
-        newBunny.color = colors[colorId];
-        newBunnies.push_back(newBunny);
-      }
+    // taking the mutex orders the push before the simulation's check
+    { std::lock_guard<std::mutex> lock(gInputWakeMutex); }
+    gInputWake.notify_one();
   }
-  setNew = 0;
 }
 
-void randomColors(std::vector<std::vector<Object>> &bunnies)
+// Called at the start of every tick: takes new input and, once a board is
+// idle, plays its oldest pending click.
+void consumeInput()
 {
-  srand(time(NULL));
-  glm::vec3 colors[] = {glm::vec3(0, 0.8, 0.8), glm::vec3(1, 0.5, 0), glm::vec3(0, 0, 0.8), glm::vec3(1, 0, 0), glm::vec3(0.4, 0, 0.8)};
-
-  int colorId;
-  for (int i = 0; i < gridrow; i++)
+  TRACE_ZONE("consumeInput");
+  InputEvent event;
+  while (gInput.pop(event))
   {
-    for (int j = 0; j < gridcol; j++)
+    gInputTakenUs = std::max(gInputTakenUs, event.timeUs);
+    if (event.type == INPUT_RESET)
     {
-      colorId = (rand() % (5));
-      if (setColor)
+      // all boards restart from the same seed, so split-screen players
+      // get the same board and the same refills for the same moves
+      uint32_t seed = gGames[0].rng.next();
+      for (int b = 0; b < gNumBoards; b++)
       {
-        bunnies[i][j] = Object();
-        bunnies[i][j].color = colors[colorId];
+        gGames[b].rng.seed(seed);
+        gGames[b].reset(gridrow, gridcol);
+        gPendingInputs[b].clear();
       }
     }
+    else if (event.board >= 0 && event.board < gNumBoards)
+    {
+      gPendingInputs[event.board].offer(event);
+    }
   }
-  setColor = 0;
-}
 
-bool pressed = 0;
-int pressrow = -1;
-int presscol = -1;
-int sliderow, slidecol;
-int EVENT = 0;
-
-//int gridcol, gridrow;
+  int64_t now = inputTimeUs();
+  for (int b = 0; b < gNumBoards; b++)
+  {
+    if (gGames[b].event == EVENT_IDLE && gPendingInputs[b].next(now, event))
+    {
+      if (gGames[b].click(event.row, event.col))
+        gTelemetry.push(TELEMETRY_INPUT, gPendingInputs[b].pending(), now - event.timeUs);
+    }
+  }
+}
 
-void normalDraw(std::vector<std::vector<Object>> &bunnies, float angle, int i, int j)
+void drawTile(const BoardFrame& frame, int j, const TileView& tile)
 {
-  glUseProgram(gProgram[0]);
-
-  glm::vec3 bunnycolor = bunnies[i][j].color;
+  glm::vec3 bunnycolor = gColors[tile.colorId];
 
-  float gridX = 20/float(gridcol);
-  float gridY = 19/float(gridrow);
+  glm::mat4 modelMat, modelMatInv;
+  tileTransform(frame, j, tile, modelMat, modelMatInv);
 
-  float scaling2 = 30.f;
+  glUniform3f(gKdLoc, bunnycolor.x, bunnycolor.y, bunnycolor.z);
+  glUniformMatrix4fv(gModelingMatLoc, 1, GL_FALSE, glm::value_ptr(modelMat));
+  glUniformMatrix4fv(gModelingMatInvTrLoc, 1, GL_FALSE, glm::value_ptr(modelMatInv));
 
-  glm::mat4 S = glm::scale(glm::mat4(1.f), glm::vec3(scaling2/(gridrow*gridcol), scaling2/(gridrow*gridcol), scaling2/(gridrow*gridcol)));
-  glm::mat4 T = glm::translate(glm::mat4(1.f), glm::vec3(-10.f + j * (gridX)+ gridX/2, 10.f - (i * (gridY) + gridY/2), -10.f));
-  glm::mat4 R = glm::rotate(glm::mat4(1.f), glm::radians(angle), glm::vec3(0, 1, 0));
-  glm::mat4 modelMat = T * R * S;
-  glm::mat4 modelMatInv = glm::transpose(glm::inverse(modelMat));
-  glm::mat4 orthoMat = glm::ortho(-10.0f, 10.0f, -10.0f, 10.0f, -20.0f, 20.0f);
-
-  glUniform3f(glGetUniformLocation(gProgram[0], "kd"), bunnycolor.x, bunnycolor.y, bunnycolor.z);
-  glUniformMatrix4fv(glGetUniformLocation(gProgram[0], "modelingMat"), 1, GL_FALSE, glm::value_ptr(modelMat));
-  glUniformMatrix4fv(glGetUniformLocation(gProgram[0], "modelingMatInvTr"), 1, GL_FALSE, glm::value_ptr(modelMatInv));
-  glUniformMatrix4fv(glGetUniformLocation(gProgram[0], "orthoMat"), 1, GL_FALSE, glm::value_ptr(orthoMat));
-
-  drawModel();
+  drawModel(tile.colorId);
 }
 
-void pop(std::vector<std::vector<Object>> &bunnies, float angle, int i, int j, float& scaling)
+// Batched tiles. With instanced arrays the tiles of all boards are sorted
+// by mesh into one instance buffer and each mesh is a single draw call, so
+// the cost per frame follows the number of tiles rather than the number of
+// boards. Without them every tile is drawn on its own with drawTile().
+struct TileInstance
 {
-  glUseProgram[0];
-
-  glm::vec3 bunnycolor = bunnies[i][j].color;
+    GLfloat modelingMat[16];
+    GLfloat kd[3];
+    GLfloat region[4]; // regionTransform() of the tile's board
+};
 
-  float gridX = 20/float(gridcol);
-  float gridY = 19/float(gridrow);
+bool gImpostorBoard[gMaxBoards]; // drawn as impostors this frame, see prepareImpostors()
 
-  float scaling2 = 30.f;
+bool gHasInstancing = false;
+GLuint gInstanceVBO;
+vector<TileInstance> gTileInstances;
+vector<int> gMeshInstances; // first instance of each mesh, then the total
+vector<int> gMeshFill;
 
-  glm::mat4 S = glm::scale(glm::mat4(1.f), glm::vec3(scaling*(scaling2/(gridrow*gridcol)), scaling*(scaling2/(gridrow*gridcol)), scaling*(scaling2/(gridrow*gridcol))));
-  glm::mat4 T = glm::translate(glm::mat4(1.f), glm::vec3(-10.f + j * (gridX)+ gridX/2, 10.f - (i * (gridY) + gridY/2), -10.f));
-  glm::mat4 R = glm::rotate(glm::mat4(1.f), glm::radians(angle), glm::vec3(0, 1, 0));
-  glm::mat4 modelMat = T * R * S;
-  glm::mat4 modelMatInv = glm::transpose(glm::inverse(modelMat));
-  glm::mat4 orthoMat = glm::ortho(-10.0f, 10.0f, -10.0f, 10.0f, -20.0f, 20.0f);
+void initTileInstancing()
+{
+    TRACE_ZONE("initTileInstancing");
+    gHasInstancing = GLEW_ARB_instanced_arrays && GLEW_ARB_draw_instanced;
+    if (!gHasInstancing)
+    {
+        cout << "No instanced arrays, drawing tiles one at a time" << endl;
+        return;
+    }
+    glGenBuffers(1, &gInstanceVBO);
+}
 
-  glUniform3f(glGetUniformLocation(gProgram[0], "kd"), bunnycolor.x, bunnycolor.y, bunnycolor.z);
-  glUniformMatrix4fv(glGetUniformLocation(gProgram[0], "modelingMat"), 1, GL_FALSE, glm::value_ptr(modelMat));
-  glUniformMatrix4fv(glGetUniformLocation(gProgram[0], "modelingMatInvTr"), 1, GL_FALSE, glm::value_ptr(modelMatInv));
-  glUniformMatrix4fv(glGetUniformLocation(gProgram[0], "orthoMat"), 1, GL_FALSE, glm::value_ptr(orthoMat));
+void drawTilesInstanced(const std::vector<BoardFrame>& frames, const glm::mat4& orthoMat)
+{
+    TRACE_ZONE("drawTiles");
+    // count the tiles of each mesh, then place every tile in its mesh's range
+    int numMeshes = gMeshes.size();
+    gMeshInstances.assign(numMeshes + 1, 0);
+    for (int b = 0; b < gNumBoards; b++)
+        for (size_t t = 0; t < frames[b].tiles.size() && !gImpostorBoard[b]; t++)
+            gMeshInstances[frames[b].tiles[t].colorId % numMeshes + 1]++;
+    for (int m = 0; m < numMeshes; m++)
+        gMeshInstances[m + 1] += gMeshInstances[m];
+    if (gMeshInstances[numMeshes] == 0)
+        return;
+
+    gTileInstances.resize(gMeshInstances[numMeshes]);
+    gMeshFill.assign(gMeshInstances.begin(), gMeshInstances.end() - 1);
+    for (int b = 0; b < gNumBoards; b++)
+    {
+        if (gImpostorBoard[b])
+            continue;
+        const BoardFrame& frame = frames[b];
+        glm::vec4 region = regionTransform(b);
+        for (int i = 0; i < frame.rows; i++)
+        {
+            for (int j = 0; j < frame.cols; j++)
+            {
+                const TileView& tile = frame.tiles[i * frame.cols + j];
+                TileInstance& instance = gTileInstances[gMeshFill[tile.colorId % numMeshes]++];
+                glm::mat4 modelMat = tileModel(frame, j, tile);
+                memcpy(instance.modelingMat, glm::value_ptr(modelMat), sizeof(instance.modelingMat));
+                memcpy(instance.kd, glm::value_ptr(gColors[tile.colorId]), sizeof(instance.kd));
+                memcpy(instance.region, glm::value_ptr(region), sizeof(instance.region));
+            }
+        }
+    }
 
-  if(scaling <= 1.5)
-    drawModel();
-  else
-  {
+    glUseProgram(gProgram[2]);
+    glUniformMatrix4fv(gTilesOrthoMatLoc, 1, GL_FALSE, glm::value_ptr(orthoMat));
+    bindModels();
 
-    bunnies[i][j].isPressed = 0;
-    bunnies[i][j].isPopped = 1;
-    for (int a = i-1; a >= 0; a--)
+    glBindBuffer(GL_ARRAY_BUFFER, gInstanceVBO);
+    glBufferData(GL_ARRAY_BUFFER, gTileInstances.size() * sizeof(TileInstance), &gTileInstances[0], GL_STREAM_DRAW);
+    for (int i = 7; i < 13; i++)
     {
-      bunnies[a][j].willSlide = 1;
+        glEnableVertexAttribArray(i);
+        glVertexAttribDivisorARB(i, 1);
     }
 
-    //sliderow = pressrow-1;
-    //slidecol = presscol;
-    //presscol = -1;
-    //pressrow = -1;
-    scaling = 1.01;
+    for (int m = 0; m < numMeshes; m++)
+    {
+        int count = gMeshInstances[m + 1] - gMeshInstances[m];
+        if (count == 0)
+            continue;
 
+        // no base instance in GL 2.1, so the pointers start at the mesh's range
+        size_t first = gMeshInstances[m] * sizeof(TileInstance);
+        for (int c = 0; c < 4; c++)
+            glVertexAttribPointer(7 + c, 4, GL_FLOAT, GL_FALSE, sizeof(TileInstance),
+                                  BUFFER_OFFSET(first + offsetof(TileInstance, modelingMat) + 4 * c * sizeof(GLfloat)));
+        glVertexAttribPointer(11, 3, GL_FLOAT, GL_FALSE, sizeof(TileInstance), BUFFER_OFFSET(first + offsetof(TileInstance, kd)));
+        glVertexAttribPointer(12, 4, GL_FLOAT, GL_FALSE, sizeof(TileInstance), BUFFER_OFFSET(first + offsetof(TileInstance, region)));
+
+        const Mesh& mesh = gMeshes[m];
+        if (gHasBaseVertex)
+            glDrawElementsInstancedBaseVertex(GL_TRIANGLES, mesh.indexCount, GL_UNSIGNED_INT,
+                                              BUFFER_OFFSET(mesh.firstIndex * sizeof(GLuint)), count, mesh.baseVertex);
+        else
+            glDrawElementsInstancedARB(GL_TRIANGLES, mesh.indexCount, GL_UNSIGNED_INT,
+                                       BUFFER_OFFSET(mesh.firstIndex * sizeof(GLuint)), count);
+    }
 
-      EVENT = 2;
-  }
-  scaling += 0.01;
+    for (int i = 7; i < 13; i++)
+    {
+        glVertexAttribDivisorARB(i, 0);
+        glDisableVertexAttribArray(i);
+    }
 }
 
-void pop2(std::vector<std::vector<Object>> &bunnies, float angle, int i, int j, float& scaling)
+// Impostors. With BUNNY_IMPOSTORS=<pixels>, boards whose tiles are at most
+// that many pixels across are drawn as point sprites cut from an atlas that
+// holds every color at gImpostorAngles spins, so a tile costs one vertex
+// however detailed its mesh is. The atlas is rendered with the tile shader
+// at startup and again whenever the tile size crosses a power of two.
+// Boards with larger tiles keep drawing the real meshes.
+struct ImpostorPoint
 {
-  glUseProgram[0];
-
-  glm::vec3 bunnycolor = bunnies[i][j].color;
-
-  float gridX = 20/float(gridcol);
-  float gridY = 19/float(gridrow);
+    GLfloat x, y;        // world position inside the board's region
+    GLfloat size;        // pixels
+    GLfloat column, row; // atlas cell: spin and color
+};
 
-  float scaling2 = 30.f;
+const int gImpostorAngles = 32;
+float gImpostorPixels = 0; // largest tile drawn as an impostor, 0 if disabled
+int gImpostorMaxCell;
+GLuint gImpostorFBO, gImpostorAtlas, gImpostorDepth, gImpostorVBO;
+int gImpostorCell = 0; // pixels per atlas cell, 0 until the atlas is rendered
+GLint gImpostorOrthoLoc, gImpostorCellSizeLoc;
+vector<ImpostorPoint> gImpostorPoints;
 
-  glm::mat4 S = glm::scale(glm::mat4(1.f), glm::vec3(scaling*(scaling2/(gridrow*gridcol)), scaling*(scaling2/(gridrow*gridcol)), scaling*(scaling2/(gridrow*gridcol))));
-  glm::mat4 T = glm::translate(glm::mat4(1.f), glm::vec3(-10.f + j * (gridX)+ gridX/2, 10.f - (i * (gridY) + gridY/2), -10.f));
-  glm::mat4 R = glm::rotate(glm::mat4(1.f), glm::radians(angle), glm::vec3(0, 1, 0));
-  glm::mat4 modelMat = T * R * S;
-  glm::mat4 modelMatInv = glm::transpose(glm::inverse(modelMat));
-  glm::mat4 orthoMat = glm::ortho(-10.0f, 10.0f, -10.0f, 10.0f, -20.0f, 20.0f);
+void initImpostors(float maxPixels)
+{
+    TRACE_ZONE("initImpostors");
+    if (!GLEW_VERSION_3_0 && !GLEW_ARB_framebuffer_object)
+    {
+        cout << "Impostors need framebuffer objects, drawing every tile as a mesh" << endl;
+        return;
+    }
 
-  glUniform3f(glGetUniformLocation(gProgram[0], "kd"), bunnycolor.x, bunnycolor.y, bunnycolor.z);
-  glUniformMatrix4fv(glGetUniformLocation(gProgram[0], "modelingMat"), 1, GL_FALSE, glm::value_ptr(modelMat));
-  glUniformMatrix4fv(glGetUniformLocation(gProgram[0], "modelingMatInvTr"), 1, GL_FALSE, glm::value_ptr(modelMatInv));
-  glUniformMatrix4fv(glGetUniformLocation(gProgram[0], "orthoMat"), 1, GL_FALSE, glm::value_ptr(orthoMat));
+    // a sprite is one point, and the atlas holds a row of cells per color
+    GLfloat pointSizes[2];
+    GLint maxTexture;
+    glGetFloatv(GL_ALIASED_POINT_SIZE_RANGE, pointSizes);
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTexture);
+    gImpostorMaxCell = std::min(128, maxTexture / gImpostorAngles);
+    gImpostorPixels = std::min(maxPixels, std::min(pointSizes[1], (float) gImpostorMaxCell));
+
+    glGenFramebuffers(1, &gImpostorFBO);
+    glGenTextures(1, &gImpostorAtlas);
+    glGenRenderbuffers(1, &gImpostorDepth);
+    glGenBuffers(1, &gImpostorVBO);
+
+    glUseProgram(gProgram[3]);
+    glUniform1i(glGetUniformLocation(gProgram[3], "atlas"), 0);
+    glUniform2f(glGetUniformLocation(gProgram[3], "cellSize"), 1.f / gImpostorAngles, 1.f / NUM_COLORS);
+    gImpostorOrthoLoc = glGetUniformLocation(gProgram[3], "orthoMat");
+}
 
-  if(scaling <= 1.5)
-  {
-    drawModel();
-    scaling += 0.01;
-  }
-  else
-  {
-    scaling = 1.01;
-    for (int a = 0; a < gridrow; a++)
+// Renders each color at each spin into its own cell, colors in rows and
+// spins in columns. The tile is lit as if at the center of the board.
+void renderImpostorAtlas(int cell, float scale)
+{
+    TRACE_ZONE("renderImpostorAtlas");
+    int width = cell * gImpostorAngles, height = cell * NUM_COLORS;
+
+    glBindTexture(GL_TEXTURE_2D, gImpostorAtlas);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindRenderbuffer(GL_RENDERBUFFER, gImpostorDepth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    // called in the middle of the board pass, which may have its own target
+    GLint framebuffer, viewport[4];
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &framebuffer);
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    GLboolean scissor = glIsEnabled(GL_SCISSOR_TEST);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, gImpostorFBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, gImpostorAtlas, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, gImpostorDepth);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (status == GL_FRAMEBUFFER_COMPLETE)
     {
-      for (int b  = 0; b < gridcol; b++)
-      {
-        if (bunnies[a][b].isMatched)
+        glDisable(GL_SCISSOR_TEST);
+        glViewport(0, 0, width, height);
+        glClearColor(0, 0, 0, 0);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        // each cell just fits the model at any spin
+        float r = gModelRadius * scale;
+        glm::mat4 orthoMat = glm::ortho(-r, r, -r, r, -20.0f, 20.0f);
+        glUseProgram(gProgram[0]);
+        bindModels();
+        glUniformMatrix4fv(gOrthoMatLoc, 1, GL_FALSE, glm::value_ptr(orthoMat));
+        glUniform4f(gRegionLoc, 0, 0, 1, 1);
+
+        for (int c = 0; c < NUM_COLORS; c++)
         {
-          bunnies[a][b].isMatched = 0;
-          bunnies[a][b].isPopped = 1;
+            glUniform3fv(gKdLoc, 1, glm::value_ptr(gColors[c]));
+            for (int a = 0; a < gImpostorAngles; a++)
+            {
+                glm::mat4 T = glm::translate(glm::mat4(1.f), glm::vec3(0, 0, -10.f));
+                glm::mat4 R = glm::rotate(glm::mat4(1.f), glm::radians(360.f * a / gImpostorAngles), glm::vec3(0, 1, 0));
+                glm::mat4 S = glm::scale(glm::mat4(1.f), glm::vec3(scale, scale, scale));
+                glm::mat4 modelMat = T * R * S;
+                glm::mat4 modelMatInvTr = glm::transpose(glm::inverse(modelMat));
+                glUniformMatrix4fv(gModelingMatLoc, 1, GL_FALSE, glm::value_ptr(modelMat));
+                glUniformMatrix4fv(gModelingMatInvTrLoc, 1, GL_FALSE, glm::value_ptr(modelMatInvTr));
+
+                glViewport(a * cell, c * cell, cell, cell);
+                drawModel(c);
+            }
         }
-      }
+        gImpostorCell = cell;
     }
-    setNew = 1;
-    addBunnies(newBunnies,1);
-    bunnies[i][j].color = newBunnies.back().color;
-    newBunnies.pop_back();
-
-    for (int a = i-1; a >= 0; a--)
+    else
     {
-      bunnies[a][j].willSlide = 1;
+        cout << "Impostor atlas incomplete (0x" << hex << status << dec << "), drawing every tile as a mesh" << endl;
+        gImpostorPixels = 0;
     }
 
-    //sliderow = pressrow-1;
-    //slidecol = presscol;
-    //presscol = -1;
-    //pressrow = -1;
-    EVENT = 0;
-  }
-
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    if (scissor)
+        glEnable(GL_SCISSOR_TEST);
+    glClearColor(0, 0, 0, 1);
 }
 
-void dropNewBunny(std::vector<std::vector<Object>> &bunnies, float angle, float& slide, int sliderow, int slidecol)
+// Pixels across the sprite of a resting tile of board b
+float impostorPixels(const BoardFrame& frame, int b, int viewportWidth, int viewportHeight)
 {
-  glUseProgram[0];
+    glm::vec4 region = regionTransform(b);
+    float diameter = 2 * gModelRadius * tileScale(frame);
+    return diameter * std::max(region.z * viewportWidth, region.w * viewportHeight) / 20;
+}
 
-  //glm::vec3 bunnycolor = glm::vec3(0, 1, 0);
-  glm::vec3 bunnycolor = newBunnies.back().color;
+// Picks the boards drawn as impostors this frame and brings the atlas up
+// to their tile size, rounded up to a power of two so that small changes,
+// e.g. from dynamic resolution, do not render it again.
+void prepareImpostors(const std::vector<BoardFrame>& frames, int viewportWidth, int viewportHeight)
+{
+    float largest = 0;
+    for (int b = 0; b < gNumBoards; b++)
+    {
+        float pixels = impostorPixels(frames[b], b, viewportWidth, viewportHeight);
+        gImpostorBoard[b] = gImpostorPixels > 0 && pixels <= gImpostorPixels;
+        if (gImpostorBoard[b])
+            largest = std::max(largest, pixels);
+    }
+    if (largest == 0)
+        return;
 
-  float gridX = 20/float(gridcol);
-  float gridY = 19/float(gridrow);
+    int cell = 8;
+    while (cell < largest && cell < gImpostorMaxCell)
+        cell *= 2;
+    if (cell != gImpostorCell)
+        renderImpostorAtlas(cell, tileScale(frames[0])); // every board has the same grid
 
-  float scaling2 = 30.f;
+    if (gImpostorPixels == 0)
+        std::fill(gImpostorBoard, gImpostorBoard + gMaxBoards, false);
+}
 
-  glm::mat4 S = glm::scale(glm::mat4(1.f), glm::vec3(scaling2/(gridrow*gridcol), scaling2/(gridrow*gridcol), scaling2/(gridrow*gridcol)));
-  glm::mat4 T = glm::translate(glm::mat4(1.f), glm::vec3(-10.f + slidecol * (gridX)+ gridX/2, 10.f - ((-1) * (gridY) + gridY/2) - slide, -10.f));
-  glm::mat4 R = glm::rotate(glm::mat4(1.f), glm::radians(angle), glm::vec3(0, 1, 0));
-  glm::mat4 modelMat = T * R * S;
-  glm::mat4 modelMatInv = glm::transpose(glm::inverse(modelMat));
-  glm::mat4 orthoMat = glm::ortho(-10.0f, 10.0f, -10.0f, 10.0f, -20.0f, 20.0f);
+// Every impostor tile of every board in one draw call.
+void drawImpostors(const std::vector<BoardFrame>& frames, const glm::mat4& orthoMat, int viewportWidth, int viewportHeight)
+{
+    TRACE_ZONE("drawImpostors");
+    gImpostorPoints.clear();
+    for (int b = 0; b < gNumBoards; b++)
+    {
+        if (!gImpostorBoard[b])
+            continue;
 
-  glUniform3f(glGetUniformLocation(gProgram[0], "kd"), bunnycolor.x, bunnycolor.y, bunnycolor.z);
-  glUniformMatrix4fv(glGetUniformLocation(gProgram[0], "modelingMat"), 1, GL_FALSE, glm::value_ptr(modelMat));
-  glUniformMatrix4fv(glGetUniformLocation(gProgram[0], "modelingMatInvTr"), 1, GL_FALSE, glm::value_ptr(modelMatInv));
-  glUniformMatrix4fv(glGetUniformLocation(gProgram[0], "orthoMat"), 1, GL_FALSE, glm::value_ptr(orthoMat));
+        const BoardFrame& frame = frames[b];
+        float gridX = 20/float(frame.cols);
+        float gridY = 19/float(frame.rows);
+        float pixels = impostorPixels(frame, b, viewportWidth, viewportHeight);
+        glm::vec4 region = regionTransform(b);
+        float column = fmodf(floorf(frame.angle / 360 * gImpostorAngles + 0.5f), gImpostorAngles);
 
-  if (slide < gridY)
-  {
-    drawModel();
-    //slide += 0.05;
-  }
-  else
-  {
-    slide = 0.05;
+        for (int i = 0; i < frame.rows; i++)
+        {
+            for (int j = 0; j < frame.cols; j++)
+            {
+                // same placement as tileModel(), moved into the board's region
+                const TileView& tile = frame.tiles[i * frame.cols + j];
+                float x = -10.f + j * gridX + gridX/2;
+                float y = 10.f - (tile.row * gridY + gridY/2);
+                ImpostorPoint point = {x * region.z + 10 * region.x, y * region.w + 10 * region.y,
+                                       pixels * tile.scale, column, (GLfloat) tile.colorId};
+                gImpostorPoints.push_back(point);
+            }
+        }
+    }
+    if (gImpostorPoints.empty())
+        return;
+
+    glBindBuffer(GL_ARRAY_BUFFER, gImpostorVBO);
+    glBufferData(GL_ARRAY_BUFFER, gImpostorPoints.size() * sizeof(ImpostorPoint), &gImpostorPoints[0], GL_STREAM_DRAW);
+
+    // as in drawParticles(), only the sprite attributes may be enabled
+    for (int i = 0; i < 3; i++)
+        glDisableVertexAttribArray(i);
+    glEnableVertexAttribArray(13);
+    glEnableVertexAttribArray(14);
+    glVertexAttribPointer(13, 3, GL_FLOAT, GL_FALSE, sizeof(ImpostorPoint), BUFFER_OFFSET(offsetof(ImpostorPoint, x)));
+    glVertexAttribPointer(14, 2, GL_FLOAT, GL_FALSE, sizeof(ImpostorPoint), BUFFER_OFFSET(offsetof(ImpostorPoint, column)));
+
+    glUseProgram(gProgram[3]);
+    glUniformMatrix4fv(gImpostorOrthoLoc, 1, GL_FALSE, glm::value_ptr(orthoMat));
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, gImpostorAtlas);
+    glDrawArrays(GL_POINTS, 0, gImpostorPoints.size());
 
-  }
+    glDisableVertexAttribArray(13);
+    glDisableVertexAttribArray(14);
+    for (int i = 0; i < 3; i++)
+        glEnableVertexAttribArray(i);
 }
 
-void drop(std::vector<std::vector<Object>> &bunnies, float angle, int i, int j, float& slide, int sliderow, int slidecol)
+// GPU board. With BUNNY_GPU_BOARD=1 a single board is played by compute
+// shaders (GL 4.3, see gpuboard.h) and drawn straight from their buffer,
+// one point per tile, for boards too large for the CPU rules and the
+// meshes. BUNNY_GPU_BOARD=validate also plays every move on the CPU and
+// compares the boards. The simulation thread leaves that board alone, so
+// its frames stay empty, and the GPU's board is neither saved nor
+// streamed to spectators.
+GpuBoard gGpuBoard;
+
+void initGpuBoard(const char* mode)
 {
-  glUseProgram[0];
+    TRACE_ZONE("initGpuBoard");
+    if (gNumBoards != 1)
+    {
+        cout << "The GPU board needs a single board, using the CPU rules" << endl;
+        return;
+    }
+    if (!GpuBoard::supported())
+    {
+        cout << "The GPU board needs OpenGL 4.3, using the CPU rules" << endl;
+        return;
+    }
 
-  glm::vec3 bunnycolor = bunnies[i][j].color;
+    const Game& game = gGames[0];
+    if (!gGpuBoard.init(&game.cells[0], game.rows, game.cols, game.rng, strcmp(mode, "validate") == 0))
+    {
+        cout << "Cannot set up the GPU board, using the CPU rules" << endl;
+        return;
+    }
+    const char* passes = getenv("BUNNY_GPU_PASSES");
+    if (passes)
+        gGpuBoard.setPassesPerFrame(atoi(passes));
 
-  float gridX = 20/float(gridcol);
-  float gridY = 19/float(gridrow);
+    // spectators would only ever see the CPU's copy of the board
+    if (gSpectators.enabled())
+    {
+        cout << "Spectating is not available with the GPU board" << endl;
+        gSpectators.stop();
+    }
+}
 
-  float scaling2 = 30.f;
+// A new board on the GPU, for the R key
+void resetGpuBoard()
+{
+    std::vector<uint8_t> cells(gGpuBoard.rows() * gGpuBoard.cols());
+    Rng rng(time(NULL));
+    generateBoard(&cells[0], gGpuBoard.rows(), gGpuBoard.cols(), rng);
+    gGpuBoard.reset(&cells[0], rng);
+}
 
-  glm::mat4 S = glm::scale(glm::mat4(1.f), glm::vec3(scaling2/(gridrow*gridcol), scaling2/(gridrow*gridcol), scaling2/(gridrow*gridcol)));
-  glm::mat4 T = glm::translate(glm::mat4(1.f), glm::vec3(-10.f + j * (gridX)+ gridX/2, 10.f - (i * (gridY) + gridY/2) - slide, -10.f));
-  glm::mat4 R = glm::rotate(glm::mat4(1.f), glm::radians(angle), glm::vec3(0, 1, 0));
-  glm::mat4 modelMat = T * R * S;
-  glm::mat4 modelMatInv = glm::transpose(glm::inverse(modelMat));
-  glm::mat4 orthoMat = glm::ortho(-10.0f, 10.0f, -10.0f, 10.0f, -20.0f, 20.0f);
+// Each point covers its tile's cell on screen
+void drawGpuBoard(const glm::mat4& orthoMat, int viewportWidth, int viewportHeight)
+{
+    TRACE_ZONE("drawGpuBoard");
+    float pixels = std::max(viewportWidth / float(gGpuBoard.cols()), 19.f / 20 * viewportHeight / gGpuBoard.rows());
+
+    // as in drawParticles(), no mesh attribute may be enabled
+    for (int i = 0; i < 3; i++)
+        glDisableVertexAttribArray(i);
+    gGpuBoard.draw(glm::value_ptr(orthoMat), glm::value_ptr(gColors[0]), std::max(1.f, ceilf(pixels)));
+    for (int i = 0; i < 3; i++)
+        glEnableVertexAttribArray(i);
+}
 
-  glUniform3f(glGetUniformLocation(gProgram[0], "kd"), bunnycolor.x, bunnycolor.y, bunnycolor.z);
-  glUniformMatrix4fv(glGetUniformLocation(gProgram[0], "modelingMat"), 1, GL_FALSE, glm::value_ptr(modelMat));
-  glUniformMatrix4fv(glGetUniformLocation(gProgram[0], "modelingMatInvTr"), 1, GL_FALSE, glm::value_ptr(modelMatInv));
-  glUniformMatrix4fv(glGetUniformLocation(gProgram[0], "orthoMat"), 1, GL_FALSE, glm::value_ptr(orthoMat));
+// Dynamic resolution. With BUNNY_FRAME_BUDGET=<ms> the board is drawn into
+// an offscreen framebuffer at a fraction of the window size, picked so the
+// board pass fits the budget, and stretched to the window. The HUD is drawn
+// on top at the window's own resolution.
+ResolutionScaler gScaler;
+GLuint gSceneFBO, gSceneColor, gSceneDepth;
+int gSceneWidth, gSceneHeight; // allocated once per window size
+int gBoardWidth, gBoardHeight; // the part of it drawn this frame
+bool gHasTimerQuery = false;
+const int gNumBoardTimers = 4; // timings are read this many frames later
+GLuint gBoardTimers[gNumBoardTimers];
+bool gBoardTimerIssued[gNumBoardTimers];
+int gBoardFrame = 0;
+double gBoardStart;
+bool gShowResolution = false; // toggled with F3
+
+// Presentation. BUNNY_SWAP_INTERVAL sets the swap interval (default 1),
+// BUNNY_FPS_CAP=<fps> paces frames by sleeping, and BUNNY_GPU_SYNC=finish
+// or fence keeps the driver from queueing frames ahead: finish waits for
+// each frame after its swap, fence waits for the previous frame right
+// before the next one samples the boards. The time from each input event
+// to the swap of the first frame made after it is always measured.
+enum GpuSync
+{
+    GPU_SYNC_NONE,
+    GPU_SYNC_FINISH,
+    GPU_SYNC_FENCE,
+};
 
-  if (slide < gridY)
-  {
-    drawModel();
-    dropNewBunny(bunnies, angle, slide, sliderow, slidecol);
-    slide += 0.05;
-  }
-  else
-  {
-    slide = 0.05;
+FramePacer gPacer;
+int gGpuSync = GPU_SYNC_NONE;
+GLsync gFrameFence = 0;
+LatencyHistogram gLatency; // GL thread only
+int64_t gShownInputUs = 0;
 
-    for(int a = sliderow; a >= 0; a--)
+void initGpuSync(const char* mode)
+{
+    if (strcmp(mode, "finish") == 0)
     {
-      bunnies[a+1][j].color = bunnies[a][j].color;
-      bunnies[a][j].willSlide = 0;
-      bunnies[a][j].isPopped = 0;
+        gGpuSync = GPU_SYNC_FINISH;
     }
+    else if (strcmp(mode, "fence") != 0)
+    {
+        cout << "Unknown BUNNY_GPU_SYNC=" << mode << ", expected finish or fence" << endl;
+    }
+    else if (GLEW_VERSION_3_2 || GLEW_ARB_sync)
+    {
+        gGpuSync = GPU_SYNC_FENCE;
+    }
+    else
+    {
+        cout << "No fence sync, waiting for each frame with glFinish" << endl;
+        gGpuSync = GPU_SYNC_FINISH;
+    }
+}
 
-    //bunnies[0][slidecol].color = glm::vec3(0, 1, 0);
-    bunnies[0][slidecol].color = newBunnies.back().color;
-
-    bunnies[sliderow+1][slidecol].isPopped = 0;
-    EVENT = 3;
-  }
+// Waits until the GPU is done with the previous frame.
+void waitForPreviousFrame()
+{
+    if (!gFrameFence)
+        return;
+    TRACE_ZONE("waitForPreviousFrame");
+    glClientWaitSync(gFrameFence, GL_SYNC_FLUSH_COMMANDS_BIT, 100000000); // 100 ms
+    glDeleteSync(gFrameFence);
+    gFrameFence = 0;
 }
 
-void drop2(std::vector<std::vector<Object>> &bunnies, float angle, int i, int j, float& slide)
+void afterSwap(const std::vector<BoardFrame>& frames)
 {
-  glUseProgram[0];
+    if (gGpuSync == GPU_SYNC_FINISH)
+    {
+        TRACE_ZONE("glFinish");
+        glFinish();
+    }
+    else if (gGpuSync == GPU_SYNC_FENCE)
+    {
+        gFrameFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
 
-  glm::vec3 bunnycolor = bunnies[i][j].color;
+    // every board's frame carries the same stamp
+    int64_t inputUs = frames[0].inputTimeUs;
+    if (inputUs > gShownInputUs)
+    {
+        int64_t latency = inputTimeUs() - inputUs;
+        gLatency.add(latency);
+        gTelemetry.push(TELEMETRY_LATENCY, 0, latency, TELEMETRY_RENDER);
+        gShownInputUs = inputUs;
+    }
+}
 
-  float gridX = 20/float(gridcol);
-  float gridY = 19/float(gridrow);
+void printLatencyReport()
+{
+    if (gLatency.count() == 0)
+        return;
+    printf("input latency: %llu events, p50 %.1f ms, p90 %.1f ms, p99 %.1f ms, max %.1f ms\n",
+           (unsigned long long) gLatency.count(), gLatency.percentileMs(0.5), gLatency.percentileMs(0.9),
+           gLatency.percentileMs(0.99), gLatency.maxMs());
+}
 
-  float scaling2 = 30.f;
+void initDynamicResolution(float budgetMs)
+{
+    TRACE_ZONE("initDynamicResolution");
+    if (!GLEW_VERSION_3_0 && !GLEW_ARB_framebuffer_object)
+    {
+        cout << "Dynamic resolution needs framebuffer objects, drawing at full size" << endl;
+        return;
+    }
 
-  glm::mat4 S = glm::scale(glm::mat4(1.f), glm::vec3(scaling2/(gridrow*gridcol), scaling2/(gridrow*gridcol), scaling2/(gridrow*gridcol)));
-  glm::mat4 T = glm::translate(glm::mat4(1.f), glm::vec3(-10.f + j * (gridX)+ gridX/2, 10.f - (i * (gridY) + gridY/2) - slide, -10.f));
-  glm::mat4 R = glm::rotate(glm::mat4(1.f), glm::radians(angle), glm::vec3(0, 1, 0));
-  glm::mat4 modelMat = T * R * S;
-  glm::mat4 modelMatInv = glm::transpose(glm::inverse(modelMat));
-  glm::mat4 orthoMat = glm::ortho(-10.0f, 10.0f, -10.0f, 10.0f, -20.0f, 20.0f);
+    glGenFramebuffers(1, &gSceneFBO);
+    glGenRenderbuffers(1, &gSceneColor);
+    glGenRenderbuffers(1, &gSceneDepth);
 
-  glUniform3f(glGetUniformLocation(gProgram[0], "kd"), bunnycolor.x, bunnycolor.y, bunnycolor.z);
-  glUniformMatrix4fv(glGetUniformLocation(gProgram[0], "modelingMat"), 1, GL_FALSE, glm::value_ptr(modelMat));
-  glUniformMatrix4fv(glGetUniformLocation(gProgram[0], "modelingMatInvTr"), 1, GL_FALSE, glm::value_ptr(modelMatInv));
-  glUniformMatrix4fv(glGetUniformLocation(gProgram[0], "orthoMat"), 1, GL_FALSE, glm::value_ptr(orthoMat));
+    // without timer queries the pass is timed on the CPU after a glFinish
+    gHasTimerQuery = GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+    if (gHasTimerQuery)
+        glGenQueries(gNumBoardTimers, gBoardTimers);
 
-  if (slide < gridY)
-  {
-    drawModel();
-    dropNewBunny(bunnies, angle, slide, sliderow, slidecol);
-    slide += 0.05;
-  }
-  else
-  {
-    slide = 0.05;
+    gScaler.setBudget(budgetMs);
+}
 
-    for(int a = sliderow; a >= 0; a--)
+void resizeSceneTarget(int width, int height)
+{
+    glBindRenderbuffer(GL_RENDERBUFFER, gSceneColor);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, gSceneDepth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, gSceneFBO);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, gSceneColor);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, gSceneDepth);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    if (status != GL_FRAMEBUFFER_COMPLETE)
     {
-      bunnies[a+1][j].color = bunnies[a][j].color;
-      bunnies[a][j].willSlide = 0;
-      bunnies[a][j].isPopped = 0;
+        cout << "Offscreen framebuffer incomplete (0x" << hex << status << dec << "), drawing at full size" << endl;
+        gScaler.setBudget(0);
+        return;
     }
 
-    //bunnies[0][slidecol].color = glm::vec3(0, 1, 0);
-    bunnies[0][slidecol].color = newBunnies.back().color;
-
-    bunnies[sliderow+1][slidecol].isPopped = 0;
-    EVENT = 3;
-  }
+    gSceneWidth = width;
+    gSceneHeight = height;
 }
 
-void matchAndPop(std::vector<std::vector<Object>> &bunnies, float angle, float& scaling, bool matched)
+// Redirects the board pass into the scaled part of the offscreen target.
+void beginBoardPass()
 {
-  for (int i = 0; i < gridrow; i++)
-  {
-    for (int j = 0; j < gridcol; j++)
+    if (!gScaler.enabled())
+        return;
+
+    int timer = gBoardFrame % gNumBoardTimers;
+    if (gHasTimerQuery)
     {
-      if (!bunnies[i][j].isMatched)
-      {
-        if (i < (gridrow - 2) && bunnies[i][j].color == bunnies[i+1][j].color && bunnies[i][j].color == bunnies[i+2][j].color)
+        // the query issued gNumBoardTimers frames ago is normally done by
+        // now; if not, its result is skipped rather than waited for
+        GLint available = 0;
+        if (gBoardTimerIssued[timer])
+            glGetQueryObjectiv(gBoardTimers[timer], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available)
         {
-          int a = 3;
-          while ( (i+a) < (gridrow) && bunnies[i][j].color == bunnies[i+a][j].color)
-          {
-            a++;
-          }
-          for (int x = i; x < (i+a); x++)
-          {
-            bunnies[x][j].isMatched = 1;
-            numOfMatched++;
-          }
-        }
-        if (j < (gridcol - 2) && bunnies[i][j].color == bunnies[i][j+1].color && bunnies[i][j].color == bunnies[i][j+2].color)
-        {
-          int b = 3;
-          while ( (j+b) < (gridcol) && bunnies[i][j].color == bunnies[i][j+b].color)
-          {
-            b++;
-          }
-          for (int x = j; x < (j+b); x++)
-          {
-            bunnies[i][x].isMatched = 1;
-            numOfMatched++;
-          }
+            GLuint64 ns;
+            glGetQueryObjectui64v(gBoardTimers[timer], GL_QUERY_RESULT, &ns);
+            gScaler.update(ns * 1e-6f);
         }
-      }
-
+        glBeginQuery(GL_TIME_ELAPSED, gBoardTimers[timer]);
+        gBoardTimerIssued[timer] = true;
     }
-  }
-
-  for (int i = 0; i < gridrow; i++)
-  {
-    for (int j = 0; j < gridcol; j++)
+    else
     {
-      if (bunnies[i][j].isMatched)
-      {
-        toDrop[j]++;
-      }
+        gBoardStart = glfwGetTime();
     }
-  }
 
-  EVENT = 4;
+    gBoardWidth = std::max(1, (int) (gSceneWidth * gScaler.scale() + 0.5f));
+    gBoardHeight = std::max(1, (int) (gSceneHeight * gScaler.scale() + 0.5f));
+
+    glBindFramebuffer(GL_FRAMEBUFFER, gSceneFBO);
+    glViewport(0, 0, gBoardWidth, gBoardHeight);
+    glScissor(0, 0, gBoardWidth, gBoardHeight); // keeps the clear to the part in use
+    glEnable(GL_SCISSOR_TEST);
 }
 
+// Stretches the board to the window and goes back to drawing into it.
+void endBoardPass()
+{
+    if (!gScaler.enabled())
+        return;
+
+    glDisable(GL_SCISSOR_TEST);
+    if (gHasTimerQuery)
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+    }
+    else
+    {
+        glFinish();
+        gScaler.update((glfwGetTime() - gBoardStart) * 1000);
+    }
+    gBoardFrame++;
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, gSceneFBO);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glBlitFramebuffer(0, 0, gBoardWidth, gBoardHeight, 0, 0, gWidth, gHeight, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, gWidth, gHeight);
 
+    // the window's depth buffer was not cleared with the board
+    glClear(GL_DEPTH_BUFFER_BIT);
+}
 
-void display(std::vector<std::vector<int>> &colorIds, std::vector<std::vector<Object>> &bunnies)
+void display(const std::vector<BoardFrame>& frames)
 {
+    TRACE_ZONE("display");
+    beginBoardPass();
+
     glClearColor(0, 0, 0, 1);
     glClearDepth(1.0f);
     glClearStencil(0);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 
-	  static float angle = 0;
-    static float scaling = 1.01;
-    static float slide = 0.05;
-    static bool matched = 0;
+    glm::mat4 orthoMat = glm::ortho(-10.0f, 10.0f, -10.0f, 10.0f, -20.0f, 20.0f);
+    int viewportWidth = gScaler.enabled() ? gBoardWidth : gWidth;
+    int viewportHeight = gScaler.enabled() ? gBoardHeight : gHeight;
 
-    randomColors(bunnies);
+    prepareImpostors(frames, viewportWidth, viewportHeight);
 
-    if (EVENT == 0)
+    if (gGpuBoard.enabled())
     {
-      for(int i = 0; i < gridrow ; i++)
+      drawGpuBoard(orthoMat, viewportWidth, viewportHeight);
+    }
+    else if (gHasInstancing)
+    {
+      drawTilesInstanced(frames, orthoMat);
+    }
+    else
+    {
+      glUseProgram(gProgram[0]);
+      bindModels();
+      glUniformMatrix4fv(gOrthoMatLoc, 1, GL_FALSE, glm::value_ptr(orthoMat));
+
+      for (int b = 0; b < gNumBoards; b++)
       {
-        for(int j = 0; j < gridcol ; j++)
+        if (gImpostorBoard[b])
+          continue;
+        const BoardFrame& frame = frames[b];
+        glUniform4fv(gRegionLoc, 1, glm::value_ptr(regionTransform(b)));
+        for(int i = 0; i < frame.rows ; i++)
         {
-            bunnies[i][j].isPopped = 0;
-            bunnies[i][j].willSlide = 0;
-            bunnies[i][j].isMatched = 0;
-
-
-            normalDraw(bunnies, angle, i, j);
+          for(int j = 0; j < frame.cols ; j++)
+          {
+            drawTile(frame, j, frame.tiles[i * frame.cols + j]);
+          }
         }
       }
     }
 
-    if (EVENT == 1)
+    drawImpostors(frames, orthoMat, viewportWidth, viewportHeight);
+    drawParticles(orthoMat, viewportHeight);
+
+    endBoardPass();
+
+    //assert(glGetError() == GL_NO_ERROR);
+
+    // each board's score in the bottom left corner of its region
+    for (int b = 0; b < gNumBoards; b++)
     {
-      if (pressrow != -1 && presscol != -1)
-      {
-        bunnies[pressrow][presscol].isPressed = 1;
-      }
-      for(int i = 0; i < gridrow ; i++)
-      {
-        for(int j = 0; j < gridcol ; j++)
-        {
-            if (!bunnies[i][j].isPressed && !bunnies[i][j].isPopped)
-              normalDraw(bunnies, angle, i, j);
-            if (bunnies[i][j].isPressed && !bunnies[i][j].isPopped)
-              pop(bunnies, angle, i, j, scaling);
+      std::string moveCount = std::to_string(gGpuBoard.enabled() ? gGpuBoard.moves() : frames[b].moveCounter);
+      std::string score = std::to_string(gGpuBoard.enabled() ? gGpuBoard.score() : frames[b].score);
 
-        }
-      }
 
+      std::string text = "Moves: " + moveCount + " Score: " + score;
+
+      BoardRegion r = boardRegion(b);
+      renderText(text, r.x * gTextWidth, r.y * gTextHeight, gNumBoards > 1 ? 0.5 : 1, glm::vec3(0, 1, 1));
     }
 
-    if (EVENT == 2)
+    if (gShowResolution)
     {
-      sliderow = pressrow-1;
-      slidecol = presscol;
+        char readout[128];
+        if (gScaler.enabled())
+            snprintf(readout, sizeof(readout), "Scale %d%% %dx%d  %.1f / %.1f ms", (int) (gScaler.scale() * 100 + 0.5f),
+                     gBoardWidth, gBoardHeight, gScaler.smoothedMs(), gScaler.budget());
+        else
+            snprintf(readout, sizeof(readout), "Scale 100%% (set BUNNY_FRAME_BUDGET)");
+        renderText(readout, 0, 40, 0.5, glm::vec3(1, 1, 0));
+
+        snprintf(readout, sizeof(readout), "Input latency p50 %.1f  p99 %.1f ms (%llu)", gLatency.percentileMs(0.5),
+                 gLatency.percentileMs(0.99), (unsigned long long) gLatency.count());
+        renderText(readout, 0, 60, 0.5, glm::vec3(1, 1, 0));
+    }
 
-      setNew = 1;
-      addBunnies(newBunnies, 1);
+    //assert(glGetError() == GL_NO_ERROR);
+}
 
-      for(int i = 0; i < gridrow ; i++)
-      {
-        for(int j = 0; j < gridcol ; j++)
-        {
-          if (!bunnies[i][j].willSlide && !bunnies[i][j].isPopped)
-            normalDraw(bunnies, angle, i, j);
-          if (bunnies[i][j].willSlide)
-            drop(bunnies, angle, i, j, slide, sliderow, slidecol);
-          if (bunnies[i][j].isPopped && pressrow == 0)
-          {
-            //normalDraw(bunnies, angle, i, j);
-            bunnies[i][j].isPopped = 0;
-            EVENT = 0;
-          }
-        }
-      }
-      //dropNewBunny(bunnies, angle, slide, sliderow, slidecol);
-      newBunnies.pop_back();
+// Frame capture. With BUNNY_CAPTURE=<file> every finished frame is read
+// back with glReadPixels into a ring of pixel buffer objects. A buffer is
+// only mapped when the ring comes back around to it, by which time the
+// copy has long finished, so the read never stalls the pipeline.
+FrameWriter gCapture;
+const int gNumCapturePBOs = 3;
+GLuint gCapturePBOs[gNumCapturePBOs];
+int gCaptureFrame = 0;
+
+void initCapture(const char* fileName)
+{
+    TRACE_ZONE("initCapture");
+    // PBOs are core in 2.1, so this works on software renderers too
+    if (!GLEW_VERSION_2_1 && !GLEW_ARB_pixel_buffer_object)
+    {
+        cout << "Frame capture needs pixel buffer objects" << endl;
+        return;
+    }
+    if (!gCapture.start(fileName, gWidth, gHeight, 60))
+    {
+        cout << "Cannot open capture file: " << fileName << endl;
+        return;
     }
 
-    if (EVENT == 3)
+    glGenBuffers(gNumCapturePBOs, gCapturePBOs);
+    for (int i = 0; i < gNumCapturePBOs; i++)
     {
-      matchAndPop(bunnies, angle, scaling, matched);
-        //EVENT = 0;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, gCapturePBOs[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, gWidth * gHeight * 4, NULL, GL_STREAM_READ);
     }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
 
-    if (EVENT == 4)
+// Copies the frame held by the currently bound PBO to the writer. Frames
+// are dropped instead of waited for unless `wait` is set.
+void flushCapturePBO(bool wait)
+{
+    void* pixels = glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+    if (pixels)
     {
-      int theresmatch = 0;
-      for(int i = 0; i < gridrow ; i++)
-      {
-        for(int j = 0; j < gridcol ; j++)
+        uint8_t* frame = gCapture.acquire(wait);
+        if (frame)
         {
-          if (!bunnies[i][j].isMatched && !bunnies[i][j].isPopped)
-            normalDraw(bunnies, angle, i, j);
-          else if (bunnies[i][j].isMatched && !bunnies[i][j].isPopped)
-          {
-            theresmatch++;
-            pop2(bunnies, angle, i, j, scaling);
-          }
+            memcpy(frame, pixels, gCapture.width() * gCapture.height() * 4);
+            gCapture.submit(frame);
         }
-      }
-      //cout << "MATCHED BUNNIES " << numOfMatched << endl;
-      if (theresmatch == 0)
-        EVENT = 0;
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
     }
+}
 
-    if (EVENT == 5)
+// Writes out the frames still in the ring and closes the recording.
+void finishCapture()
+{
+    if (!gCapture.enabled())
+        return;
+
+    int first = std::max(0, gCaptureFrame - gNumCapturePBOs);
+    for (int i = first; i < gCaptureFrame; i++)
     {
-      /*
-      for(int i = 0; i < gridrow ; i++)
-      {
-        for(int j = 0; j < gridcol ; j++)
-        {
-          if (!bunnies[i][j].isPopped)
-          {
-            for (int a = i+1; a < gridrow; i++)
-            {
-              if (bunnies[a][j].isPopped)
-              {
-                bunnies[i][j].ySlide++;
-                bunnies[i][j].willSlide = 1;
-              }
-            }
-            if (bunnies[i][j].ySlide == 0)
-              bunnies[i][j].willSlide = 0;
-          }
-        }
-      }
-      */
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, gCapturePBOs[i % gNumCapturePBOs]);
+        flushCapturePBO(true);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glDeleteBuffers(gNumCapturePBOs, gCapturePBOs);
 
-      for(int i = 0; i < gridrow ; i++)
-      {
-        for(int j = 0; j < gridcol ; j++)
-        {
-          if (!bunnies[i][j].willSlide && !bunnies[i][j].isPopped)
-            normalDraw(bunnies, angle, i, j);
-          //if (toDrop[j] != 0)
-            //drop(bunnies, angle, i, j, slide, sliderow, slidecol);
-        }
-      }
+    gCapture.stop();
+    cout << "Captured " << gCapture.written() << " frames, dropped " << gCapture.dropped() << endl;
+}
+
+// Called after display(), before the swap.
+void captureFrame()
+{
+    TRACE_ZONE("captureFrame");
+    if (!gCapture.enabled())
+        return;
+
+    // the recording keeps its size; stop if the window no longer matches
+    if (gWidth != gCapture.width() || gHeight != gCapture.height())
+    {
+        cout << "Window resized, frame capture stopped" << endl;
+        finishCapture();
+        return;
     }
 
-    //assert(glGetError() == GL_NO_ERROR);
+    int pbo = gCaptureFrame % gNumCapturePBOs;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, gCapturePBOs[pbo]);
+    if (gCaptureFrame >= gNumCapturePBOs)
+        flushCapturePBO(false); // the frame from gNumCapturePBOs frames ago
 
-    std::string moveCount = std::to_string(moveCounter);
-    std::string score = std::to_string(numOfMatched);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadBuffer(GL_BACK);
+    glReadPixels(0, 0, gWidth, gHeight, GL_RGBA, GL_UNSIGNED_BYTE, BUFFER_OFFSET(0));
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    gCaptureFrame++;
+}
 
+// Fills and publishes the frame of every board, ticking the boards first
+// if `tick` is set.
+void publishFrames(bool tick)
+{
+  for (int b = 0; b < gNumBoards; b++)
+  {
+    if (gGpuBoard.enabled())
+      continue; // played by the GPU
+    TRACE_ZONE("board");
+    if (tick)
+      gGames[b].tick();
+
+    BoardFrame& frame = gFrames.back()[b];
+    gGames[b].fillFrame(frame);
+    frame.inputTimeUs = gInputTakenUs;
+    int row, col;
+    if (gPendingInputs[b].selected(row, col))
+      frame.tiles[row * frame.cols + col].scale *= 1.2f;
+  }
+  gFrames.publish();
+}
 
-    std::string text = "Moves: " + moveCount + " Score: " + score;
+// Sleeps until the next tick. In low-latency mode input arriving in the
+// meantime is played and shown right away; time only advances with ticks.
+void waitForTick(std::chrono::steady_clock::time_point nextTick)
+{
+  if (!gLowLatency)
+  {
+    std::this_thread::sleep_until(nextTick);
+    return;
+  }
 
-    renderText(text, 0, 0, 1, glm::vec3(0, 1, 1));
+  while (true)
+  {
+    std::unique_lock<std::mutex> lock(gInputWakeMutex);
+    if (!gInputWake.wait_until(lock, nextTick, [] { return !gInput.empty(); }))
+      return;
+    lock.unlock();
 
-    //assert(glGetError() == GL_NO_ERROR);
+    consumeInput();
+    publishFrames(false);
+  }
+}
+
+void simulationLoop()
+{
+  const std::chrono::duration<double> period(1.0 / gTickRate);
+  std::chrono::steady_clock::time_point nextTick = std::chrono::steady_clock::now();
+  std::chrono::steady_clock::time_point lastSave = nextTick;
+
+  TRACE_THREAD("simulation");
+  while (gSimRunning.load(std::memory_order_acquire))
+  {
+    consumeInput();
+    publishFrames(true);
+
+    if (gSpectators.enabled())
+      gSpectators.publish(gGames, gNumBoards);
+
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (gAutosaver.enabled() && now - lastSave >= std::chrono::duration<double>(gAutosaveInterval))
+    {
+      gGames[0].capture(gAutosaver.capture());
+      gAutosaver.submit();
+      lastSave = now;
+    }
 
-	angle += 0.5;
+    // run late ticks back to back, but give up catching up after a long stall
+    nextTick += std::chrono::duration_cast<std::chrono::steady_clock::duration>(period);
+    if (now - nextTick > std::chrono::duration<double>(0.25))
+      nextTick = now;
+    waitForTick(nextTick);
+  }
 }
 
 
@@ -1087,6 +1606,24 @@ void reshape(GLFWwindow* window, int w, int h)
     gHeight = h;
 
     glViewport(0, 0, w, h);
+
+    if (gScaler.enabled() && (w != gSceneWidth || h != gSceneHeight))
+        resizeSceneTarget(w, h);
+}
+
+// Writes the zones recorded so far to BUNNY_TRACE (default
+// bunny_trace.json). Only builds made with `make trace` record any.
+void dumpTrace()
+{
+#if TRACE_ENABLED
+    const char* traceFile = getenv("BUNNY_TRACE");
+    if (!traceFile)
+        traceFile = "bunny_trace.json";
+    if (traceDump(traceFile))
+        cout << "Trace written to " << traceFile << endl;
+    else
+        cout << "Cannot write trace: " << traceFile << endl;
+#endif
 }
 
 void keyboard(GLFWwindow* window, int key, int scancode, int action, int mods)
@@ -1097,68 +1634,213 @@ void keyboard(GLFWwindow* window, int key, int scancode, int action, int mods)
     }
     else if (key == GLFW_KEY_R && action == GLFW_PRESS)
     {
-        setColor = 1;
-        randomColors(bunnies);
-        EVENT = 0;
-        moveCounter = 0;
-        numOfMatched = 0;
+        if (gGpuBoard.enabled())
+            resetGpuBoard();
+        else
+            postInput(INPUT_RESET, 0, 0, 0);
+    }
+    else if (key == GLFW_KEY_F3 && action == GLFW_PRESS)
+    {
+        gShowResolution = !gShowResolution;
+    }
+    else if (key == GLFW_KEY_F4 && action == GLFW_PRESS)
+    {
+        dumpTrace();
     }
 }
 
 void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
 {
-    // grid size
-    float gridX = gWidth/gridcol;
-    float gridY = (gHeight-60)/gridrow;
-
     if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS)
     {
-        cout << "MOUSE PRESSED" << endl;
         double x, y;
         glfwGetCursorPos(window, &x, &y);
-        cout << "Cursor Position at (" << x << " : " << y << endl;
+
+        // the board whose region was clicked, and the cursor inside it
+        float regionW = gWidth / float(gLayoutCols);
+        float regionH = gHeight / float(gLayoutRows);
+        if (x < 0 || y < 0)
+          return;
+        int regionCol = x / regionW;
+        int regionRow = y / regionH;
+        int board = regionRow * gLayoutCols + regionCol;
+        if (regionCol >= gLayoutCols || board >= gNumBoards)
+          return;
+        x -= regionCol * regionW;
+        y -= regionRow * regionH;
+
+        // grid size
+        float gridX = regionW / gridcol;
+        float gridY = (regionH - 60.f / gLayoutRows) / gridrow;
+
         int a = x/gridX;
         int b = y/gridY;
-        cout << "BUNNY NUMBER " << b << " by " << a << endl;
-        if (EVENT == 0)
-        {
-          pressrow = b;
-          presscol = a;
-          EVENT = 1;
-          moveCounter++;
-        }
+        if (a < 0 || a >= gridcol || b < 0 || b >= gridrow)
+          return;
+        if (gGpuBoard.enabled())
+          gGpuBoard.click(b, a);
+        else
+          postInput(INPUT_CLICK, board, b, a);
     }
 }
 
 
 
+// Rough resident memory per subsystem. GPU sizes are what was asked of the
+// driver, which may pad or keep extra copies.
+void printMemoryReport()
+{
+    size_t meshCpu = gMeshes.capacity() * sizeof(Mesh);
+    size_t meshGpu = gVertexDataSizeInBytes + gNormalDataSizeInBytes + gIndexDataSizeInBytes;
+
+    // map nodes: the pair plus three links and a color
+    size_t glyphCpu = Characters.size() * (sizeof(std::pair<const GLchar, Character>) + 4 * sizeof(void*));
+    size_t glyphGpu = 6 * 4 * sizeof(GLfloat); // gTextVBO
+    for (std::map<GLchar, Character>::const_iterator it = Characters.begin(); it != Characters.end(); ++it)
+        glyphGpu += it->second.Size.x * it->second.Size.y; // one byte per texel
+
+    size_t boardCpu = sizeof(gGames) + sizeof(gFrames);
+    for (int b = 0; b < gNumBoards; b++)
+        boardCpu += gGames[b].memoryUsage();
+    for (int i = 0; i < 3; i++)
+        for (int b = 0; b < gNumBoards; b++)
+            boardCpu += sizeof(BoardFrame) + gFrames.buffer(i)[b].tiles.capacity() * sizeof(TileView);
+    boardCpu += gTileInstances.capacity() * sizeof(TileInstance);
+    boardCpu += gImpostorPoints.capacity() * sizeof(ImpostorPoint);
+
+    size_t particleCpu = gParticles.memoryUsage() + sizeof(gBursts);
+    size_t particleGpu = ParticleSystem::CAPACITY * (3 * sizeof(float) + 1);
+
+    size_t targetGpu = gScaler.enabled() ? (size_t) gSceneWidth * gSceneHeight * 8 : 0;
+
+    // the atlas follows the tile size; this is its upper bound
+    size_t impostorGpu = gImpostorPixels > 0 ? (size_t) gImpostorMaxCell * gImpostorAngles * gImpostorMaxCell * NUM_COLORS * 8 : 0;
+
+    size_t captureCpu = 0, captureGpu = 0;
+    if (gCapture.enabled())
+    {
+        size_t frame = (size_t) gCapture.width() * gCapture.height() * 4;
+        captureCpu = FrameWriter::NUM_BUFFERS * frame;
+        captureGpu = gNumCapturePBOs * frame;
+    }
+
+    printf("%-12s %10s %10s\n", "memory", "CPU KiB", "GPU KiB");
+    printf("%-12s %10zu %10zu  (%zu KiB while loading, freed)\n", "mesh", meshCpu / 1024, meshGpu / 1024, gLoadPeakBytes / 1024);
+    printf("%-12s %10zu %10zu\n", "glyphs", glyphCpu / 1024, glyphGpu / 1024);
+    printf("%-12s %10zu %10zu\n", "board", boardCpu / 1024, (size_t) 0);
+    printf("%-12s %10zu %10zu\n", "particles", particleCpu / 1024, particleGpu / 1024);
+    if (targetGpu)
+        printf("%-12s %10zu %10zu\n", "render target", (size_t) 0, targetGpu / 1024);
+    if (impostorGpu)
+        printf("%-12s %10zu %10zu  (atlas at most)\n", "impostors", (size_t) 0, impostorGpu / 1024);
+    if (captureCpu)
+        printf("%-12s %10zu %10zu\n", "capture", captureCpu / 1024, captureGpu / 1024);
+    if (gGpuBoard.enabled())
+        printf("%-12s %10zu %10zu\n", "gpu board", (size_t) 0, gGpuBoard.gpuBytes() / 1024);
+}
+
 void mainLoop(GLFWwindow* window)
 {
-  glm::vec3 colors[] = {glm::vec3(0, 0.8, 0.8), glm::vec3(1, 0.5, 0), glm::vec3(0, 0, 0.8), glm::vec3(1, 0, 0), glm::vec3(0.4, 0, 0.8)};
+  InputPolicy policy = parseInputPolicy(getenv("BUNNY_INPUT"));
+  for (int b = 0; b < gNumBoards; b++)
+  {
+    gGames[b].telemetry = &gTelemetry;
+    gGames[b].bursts = &gBursts[b];
+    gGames[b].reset(gridrow, gridcol);
+    gPendingInputs[b].policy = policy;
+  }
 
-  std::vector<std::vector<int>> colorIds;
-  colorIds.resize(gridrow, vector<int>(gridcol, 0));
+  // continue the previous session if it was played on the same grid; a
+  // split screen always starts fresh and is not saved
+  const char* saveFile = getenv("BUNNY_SAVE");
+  if (!saveFile)
+    saveFile = "bunny_crush.sav";
 
-//  std::vector<std::vector<Object>> bunnies;
-  bunnies.resize(gridrow, vector<Object>(gridcol, Object()));
-  toDrop.resize(gridcol, 0);
+  if (gNumBoards == 1)
+  {
+    GameSnapshot saved;
+    if (loadSnapshot(saveFile, saved) && !gGames[0].restore(saved))
+    {
+      if (saved.rows != gGames[0].rows || saved.cols != gGames[0].cols)
+        cout << "Ignoring " << saveFile << ": saved on a " << saved.cols << "x" << saved.rows << " grid" << endl;
+      else
+        cout << "Ignoring " << saveFile << ": invalid game state" << endl;
+    }
+  }
+
+  const char* gpuBoard = getenv("BUNNY_GPU_BOARD");
+  if (gpuBoard && strcmp(gpuBoard, "0") != 0)
+    initGpuBoard(gpuBoard);
+
+  // the CPU copy of a GPU board never changes, so there is nothing to save
+  if (gNumBoards == 1 && !gGpuBoard.enabled())
+    gAutosaver.start(saveFile);
+
+  // every buffer starts out with a valid frame of the right size
+  for (int i = 0; i < 3; i++)
+  {
+    gFrames.buffer(i).resize(gNumBoards);
+    for (int b = 0; b < gNumBoards && !gGpuBoard.enabled(); b++)
+      gGames[b].fillFrame(gFrames.buffer(i)[b]);
+  }
+
+  printMemoryReport();
 
-  setColor = 1;
+  gSimRunning.store(true, std::memory_order_release);
+  std::thread simulation(simulationLoop);
 
+    TRACE_THREAD("render");
+    double lastTime = glfwGetTime();
     while (!glfwWindowShouldClose(window))
     {
-        display(colorIds, bunnies);
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+        TRACE_ZONE("frame");
+        gPacer.wait();
+        if (gLowLatency)
+            glfwPollEvents();
+        waitForPreviousFrame();
+        gGpuBoard.update();
+
+        const std::vector<BoardFrame>& frames = gFrames.latest();
+        updateParticles(frames, std::min(glfwGetTime() - lastTime, 0.1));
+        display(frames);
+        captureFrame();
+        {
+            TRACE_ZONE("glfwSwapBuffers");
+            glfwSwapBuffers(window);
+        }
+        afterSwap(frames);
+        if (!gLowLatency)
+            glfwPollEvents();
+
+        double now = glfwGetTime();
+        gTelemetry.push(TELEMETRY_FRAME, 0, (now - lastTime) * 1e6, TELEMETRY_RENDER);
+        lastTime = now;
     }
+
+  gSimRunning.store(false, std::memory_order_release);
+  simulation.join();
+  finishCapture();
+  gSpectators.stop();
+  waitForPreviousFrame();
+  printLatencyReport();
+  if (gGpuBoard.validated() + gGpuBoard.mismatches() > 0)
+    printf("GPU board: %d checks against the CPU rules, %d mismatches\n", gGpuBoard.validated(), gGpuBoard.mismatches());
+  gGpuBoard.release();
+
+  if (gAutosaver.enabled())
+  {
+    gGames[0].capture(gAutosaver.capture());
+    gAutosaver.submit();
+    gAutosaver.stop(); // waits for the final save
+  }
 }
 
 int main(int argc, char** argv)   // Create Main Function For Bringing It All Together
 {
-    if (argc != 4)
+    if (argc < 4)
     {
         cout << "Please run the program as:" << endl
-             << "\t./main <grid_width> <grid_height> <input_file_name>" << endl;
+             << "\t./main <grid_width> <grid_height> <input_file_name> [<input_file_name> ...]" << endl;
         return 1;
     }
 
@@ -1170,7 +1852,17 @@ int main(int argc, char** argv)   // Create Main Function For Bringing It All To
         const char *h = argv[2];
         sscanf(h, "%d", &gridrow);
 
-        const char *input_file_name = argv[3];
+        // 8x8, 9x9 and 10x10 boards run rules compiled for their size
+        cout << "Board kernels: " << boardKernelName(gridrow, gridcol) << endl;
+
+        // the same seed for every board, see consumeInput()
+        const char* boards = getenv("BUNNY_BOARDS");
+        setBoardLayout(boards ? atoi(boards) : 1);
+        for (int b = 0; b < gNumBoards; b++)
+            gGames[b].rng.seed(time(NULL));
+
+        // keep each board's region about as wide as a single board window
+        gWidth = gWidth * gLayoutCols / gLayoutRows;
 
         GLFWwindow* window;
         if (!glfwInit())
@@ -1192,7 +1884,8 @@ int main(int argc, char** argv)   // Create Main Function For Bringing It All To
         }
 
         glfwMakeContextCurrent(window);
-        glfwSwapInterval(1);
+        const char* swapInterval = getenv("BUNNY_SWAP_INTERVAL");
+        glfwSwapInterval(swapInterval ? atoi(swapInterval) : 1);
 
         // Initialize GLEW to setup the OpenGL Function pointers
         if (GLEW_OK != glewInit())
@@ -1207,7 +1900,48 @@ int main(int argc, char** argv)   // Create Main Function For Bringing It All To
         strcat(rendererInfo, (const char*) glGetString(GL_VERSION));
         glfwSetWindowTitle(window, rendererInfo);
 
-        init(input_file_name);
+        init(argc - 3, argv + 3); // one mesh per file, picked by tile color
+        initTileInstancing();
+
+        const char* lowLatency = getenv("BUNNY_LOW_LATENCY");
+        gLowLatency = lowLatency && atoi(lowLatency) != 0;
+        const char* fpsCap = getenv("BUNNY_FPS_CAP");
+        gPacer.setRate(fpsCap ? atof(fpsCap) : 0);
+        const char* gpuSync = getenv("BUNNY_GPU_SYNC");
+        if (gpuSync)
+        {
+            initGpuSync(gpuSync);
+        }
+
+        const char* impostorPixels = getenv("BUNNY_IMPOSTORS");
+        if (impostorPixels && atof(impostorPixels) > 0)
+        {
+            initImpostors(atof(impostorPixels));
+        }
+
+        const char* telemetryFile = getenv("BUNNY_TELEMETRY");
+        if (telemetryFile && !gTelemetry.start(telemetryFile))
+        {
+            cout << "Cannot open telemetry log: " << telemetryFile << endl;
+        }
+
+        const char* spectateAddress = getenv("BUNNY_SPECTATE");
+        if (spectateAddress && !gSpectators.start(spectateAddress))
+        {
+            cout << "Cannot listen for spectators on " << spectateAddress << endl;
+        }
+
+        const char* captureFile = getenv("BUNNY_CAPTURE");
+        if (captureFile)
+        {
+            initCapture(captureFile);
+        }
+
+        const char* frameBudget = getenv("BUNNY_FRAME_BUDGET");
+        if (frameBudget && atof(frameBudget) > 0)
+        {
+            initDynamicResolution(atof(frameBudget));
+        }
 
         glfwSetKeyCallback(window, keyboard);
         glfwSetMouseButtonCallback(window, mouse_button_callback);
@@ -1215,6 +1949,9 @@ int main(int argc, char** argv)   // Create Main Function For Bringing It All To
 
         reshape(window, gWidth, gHeight); // need to call this once ourselves
         mainLoop(window); // this does not return unless the window is closed
+        dumpTrace();
+
+        gTelemetry.stop();
 
         glfwDestroyWindow(window);
         glfwTerminate();
@@ -0,0 +1,351 @@
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include "objloader.h"
+
+// A face corner: position, texcoord and normal index, -1 when absent
+struct Corner
+{
+    int32_t v, t, n;
+};
+
+/// Open-addressing map from a corner to its vertex index, with linear
+/// probing. It doubles whenever it gets half full.
+class WeldMap
+{
+public:
+    WeldMap() : mCount(0) { resize(4096); }
+
+    /// Index stored for the corner; if there is none yet, stores `next`.
+    uint32_t insert(const Corner& key, uint32_t next, bool& inserted)
+    {
+        if (2 * (mCount + 1) > mTable.size())
+            resize(2 * mTable.size());
+
+        size_t mask = mTable.size() - 1;
+        for (size_t i = hash(key) & mask; ; i = (i + 1) & mask)
+        {
+            Entry& e = mTable[i];
+            if (e.key.v < 0)
+            {
+                e.key = key;
+                e.index = next;
+                mCount++;
+                inserted = true;
+                return next;
+            }
+            if (e.key.v == key.v && e.key.t == key.t && e.key.n == key.n)
+            {
+                inserted = false;
+                return e.index;
+            }
+        }
+    }
+
+private:
+    struct Entry
+    {
+        Corner key; // key.v < 0 marks an empty slot
+        uint32_t index;
+    };
+
+    static uint64_t hash(const Corner& key)
+    {
+        uint64_t h = (uint32_t) key.v * 0x9e3779b97f4a7c15ull;
+        h ^= ((uint32_t) key.t + 1) * 0xc2b2ae3d27d4eb4full + (h >> 29);
+        h ^= ((uint32_t) key.n + 1) * 0x165667b19e3779f9ull + (h >> 32);
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdull;
+        return h ^ (h >> 33);
+    }
+
+    void resize(size_t capacity)
+    {
+        std::vector<Entry> old(capacity);
+        old.swap(mTable);
+        for (size_t i = 0; i < mTable.size(); i++)
+            mTable[i].key.v = -1;
+
+        size_t mask = capacity - 1;
+        for (size_t j = 0; j < old.size(); j++)
+        {
+            if (old[j].key.v < 0)
+                continue;
+            size_t i = hash(old[j].key) & mask;
+            while (mTable[i].key.v >= 0)
+                i = (i + 1) & mask;
+            mTable[i] = old[j];
+        }
+    }
+
+    std::vector<Entry> mTable;
+    size_t mCount;
+};
+
+// Runs fn(begin, end) over [0, n) split between the available cores, or
+// on this thread when there is too little work to be worth it.
+template <typename F>
+static void parallelFor(size_t n, size_t minPerThread, F fn)
+{
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = std::min(threads, std::max<size_t>(1, n / minPerThread));
+    if (threads <= 1)
+    {
+        fn(0, n);
+        return;
+    }
+
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < threads; i++)
+        workers.push_back(std::thread(fn, n * i / threads, n * (i + 1) / threads));
+    for (size_t i = 0; i < workers.size(); i++)
+        workers[i].join();
+}
+
+// Smooth normals for the vertices [base, data.vertices.size()) from the
+// triangles from firstIndex on. Each face adds its unnormalized normal,
+// whose length is twice its area, to every position it uses, so vertices
+// that only differ in texcoords still share one normal.
+static void generateNormals(ObjData& data, uint32_t base, size_t firstIndex,
+                            const std::vector<int32_t>& vertexPosition, size_t numPositions)
+{
+    size_t numTriangles = (data.indices.size() - firstIndex) / 3;
+    std::vector<Normal> faceNormals(numTriangles, Normal(0, 0, 0));
+
+    parallelFor(numTriangles, 16384, [&](size_t begin, size_t end) {
+        for (size_t f = begin; f < end; f++)
+        {
+            const Vertex& a = data.vertices[base + data.indices[firstIndex + 3 * f]];
+            const Vertex& b = data.vertices[base + data.indices[firstIndex + 3 * f + 1]];
+            const Vertex& c = data.vertices[base + data.indices[firstIndex + 3 * f + 2]];
+            float ux = b.x - a.x, uy = b.y - a.y, uz = b.z - a.z;
+            float vx = c.x - a.x, vy = c.y - a.y, vz = c.z - a.z;
+            faceNormals[f] = Normal(uy * vz - uz * vy, uz * vx - ux * vz, ux * vy - uy * vx);
+        }
+    });
+
+    // faces around each position, so positions can be summed independently
+    std::vector<uint32_t> start(numPositions + 1, 0);
+    for (size_t i = firstIndex; i < data.indices.size(); i++)
+        start[vertexPosition[data.indices[i]] + 1]++;
+    for (size_t p = 0; p < numPositions; p++)
+        start[p + 1] += start[p];
+
+    std::vector<uint32_t> faces(data.indices.size() - firstIndex);
+    std::vector<uint32_t> fill(start.begin(), start.end() - 1);
+    for (size_t i = firstIndex; i < data.indices.size(); i++)
+        faces[fill[vertexPosition[data.indices[i]]]++] = (i - firstIndex) / 3;
+
+    std::vector<Normal> positionNormals(numPositions, Normal(0, 0, 1));
+    parallelFor(numPositions, 16384, [&](size_t begin, size_t end) {
+        for (size_t p = begin; p < end; p++)
+        {
+            float x = 0, y = 0, z = 0;
+            for (uint32_t k = start[p]; k < start[p + 1]; k++)
+            {
+                x += faceNormals[faces[k]].x;
+                y += faceNormals[faces[k]].y;
+                z += faceNormals[faces[k]].z;
+            }
+            float length = sqrtf(x * x + y * y + z * z);
+            if (length > 0)
+                positionNormals[p] = Normal(x / length, y / length, z / length);
+        }
+    });
+
+    parallelFor(vertexPosition.size(), 16384, [&](size_t begin, size_t end) {
+        for (size_t w = begin; w < end; w++)
+            data.normals[base + w] = positionNormals[vertexPosition[w]];
+    });
+}
+
+// Reads an OBJ index after `p`. Positive indices count from 1, negative
+// ones back from the latest element. Returns -1 if out of range.
+static int32_t parseIndex(const char*& p, size_t count)
+{
+    char* end;
+    long i = strtol(p, &end, 10);
+    if (end == p)
+        return -1;
+    p = end;
+    long resolved = i > 0 ? i - 1 : (long) count + i;
+    return i != 0 && resolved >= 0 && resolved < (long) count ? resolved : -1;
+}
+
+// Reads up to n floats after `p`; missing ones are left as they are.
+static void parseFloats(const char* p, float* out, int n)
+{
+    for (int i = 0; i < n; i++)
+    {
+        char* end;
+        float f = strtof(p, &end);
+        if (end == p)
+            return;
+        out[i] = f;
+        p = end;
+    }
+}
+
+static bool isKeyword(const char* line, const char* keyword)
+{
+    size_t n = strlen(keyword);
+    return strncmp(line, keyword, n) == 0 && (line[n] == 0 || isspace((unsigned char) line[n]));
+}
+
+bool parseObj(const std::string& fileName, ObjData& data)
+{
+    FILE* file = fopen(fileName.c_str(), "rb");
+    if (!file)
+        return false;
+
+    // the raw lists are only needed while parsing this file
+    Arena scratch;
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char* text = (char*) scratch.alloc(size + 1);
+    bool ok = size >= 0 && fread(text, 1, size, file) == (size_t) size;
+    fclose(file);
+    if (!ok)
+        return false;
+    text[size] = 0;
+
+    ArenaList<Vertex> positions(scratch);
+    ArenaList<Texture> texcoords(scratch);
+    ArenaList<Normal> normals(scratch);
+
+    uint32_t base = data.vertices.size();
+    size_t firstIndex = data.indices.size();
+    std::vector<int32_t> vertexPosition; // position of each new vertex
+    WeldMap weld;
+    std::vector<Corner> polygon;
+    std::vector<uint32_t> polygonIndices;
+    bool missingNormals = false;
+    int skipped = 0;
+
+    for (char* line = text; line < text + size; )
+    {
+        char* eol = strchr(line, '\n');
+        if (eol)
+            *eol = 0; // numbers must not be read from the next line
+        char* next = eol ? eol + 1 : text + size;
+
+        while (*line == ' ' || *line == '\t')
+            line++;
+
+        if (*line == 0 || *line == '\r' || *line == '#') // blank or comment
+        {
+        }
+        else if (isKeyword(line, "v"))
+        {
+            float xyz[3] = {0, 0, 0};
+            parseFloats(line + 1, xyz, 3);
+            positions.push_back(Vertex(xyz[0], xyz[1], xyz[2]));
+        }
+        else if (isKeyword(line, "vt"))
+        {
+            float uv[2] = {0, 0};
+            parseFloats(line + 2, uv, 2);
+            texcoords.push_back(Texture(uv[0], uv[1]));
+        }
+        else if (isKeyword(line, "vn"))
+        {
+            float xyz[3] = {0, 0, 0};
+            parseFloats(line + 2, xyz, 3);
+            normals.push_back(Normal(xyz[0], xyz[1], xyz[2]));
+        }
+        else if (isKeyword(line, "f"))
+        {
+            // v, v/t, v//n or v/t/n per corner
+            polygon.clear();
+            bool valid = true;
+            const char* p = line + 1;
+            while (true)
+            {
+                while (isspace((unsigned char) *p))
+                    p++;
+                if (*p == 0)
+                    break;
+
+                Corner c;
+                c.v = parseIndex(p, positions.size());
+                c.t = c.n = -1;
+                if (*p == '/')
+                {
+                    p++;
+                    if (*p != '/')
+                        valid = (c.t = parseIndex(p, texcoords.size())) >= 0 && valid;
+                    if (*p == '/')
+                    {
+                        p++;
+                        valid = (c.n = parseIndex(p, normals.size())) >= 0 && valid;
+                    }
+                }
+                if (c.v < 0 || (*p && !isspace((unsigned char) *p)))
+                {
+                    valid = false;
+                    break;
+                }
+                polygon.push_back(c);
+            }
+
+            if (!valid || polygon.size() < 3)
+            {
+                skipped++;
+            }
+            else
+            {
+                // weld the corners, then fan the polygon into triangles
+                polygonIndices.clear();
+                for (size_t k = 0; k < polygon.size(); k++)
+                {
+                    const Corner& c = polygon[k];
+                    if (c.n < 0)
+                        missingNormals = true;
+
+                    bool inserted;
+                    uint32_t index = weld.insert(c, vertexPosition.size(), inserted);
+                    if (inserted)
+                    {
+                        data.vertices.push_back(positions[c.v]);
+                        data.textures.push_back(c.t >= 0 ? texcoords[c.t] : Texture(0, 0));
+                        data.normals.push_back(c.n >= 0 ? normals[c.n] : Normal(0, 0, 0));
+                        vertexPosition.push_back(c.v);
+                    }
+                    polygonIndices.push_back(index);
+                }
+                for (size_t k = 1; k + 1 < polygonIndices.size(); k++)
+                {
+                    data.indices.push_back(polygonIndices[0]);
+                    data.indices.push_back(polygonIndices[k]);
+                    data.indices.push_back(polygonIndices[k + 1]);
+                }
+            }
+        }
+        else if (isKeyword(line, "o") || isKeyword(line, "g") || isKeyword(line, "s") || isKeyword(line, "l") ||
+                 isKeyword(line, "p") || isKeyword(line, "vp") || isKeyword(line, "usemtl") || isKeyword(line, "mtllib"))
+        {
+            // not used for drawing
+        }
+        else
+        {
+            std::cout << "Ignoring unidentified line in obj file: " << line << std::endl;
+        }
+
+        line = next;
+    }
+
+    if (skipped)
+        std::cout << "Skipped " << skipped << " faces with missing or invalid indices in " << fileName << std::endl;
+
+    if (missingNormals)
+        generateNormals(data, base, firstIndex, vertexPosition, positions.size());
+
+    return true;
+}
@@ -0,0 +1,60 @@
+#ifndef OBJLOADER_H
+#define OBJLOADER_H
+
+#include <cstdint>
+#include <string>
+#include "arena.h"
+
+// OBJ parsing, kept free of OpenGL so it can be benchmarked on its own.
+
+struct Vertex
+{
+    Vertex(float inX, float inY, float inZ) : x(inX), y(inY), z(inZ) { }
+    float x, y, z;
+};
+
+struct Texture
+{
+    Texture(float inU, float inV) : u(inU), v(inV) { }
+    float u, v;
+};
+
+struct Normal
+{
+    Normal(float inX, float inY, float inZ) : x(inX), y(inY), z(inZ) { }
+    float x, y, z;
+};
+
+/// Geometry of one or more OBJ files, stored in an arena until uploaded.
+/// Every (position, texcoord, normal) combination used by a face becomes one
+/// vertex; the three lists below hold one entry per such vertex. Indices
+/// form triangles and are relative to the file they came from.
+struct ObjData
+{
+    ObjData() : vertices(arena), textures(arena), normals(arena), indices(arena) { }
+
+    /// Frees everything parsed so far.
+    void release()
+    {
+        vertices.clear();
+        textures.clear();
+        normals.clear();
+        indices.clear();
+        arena.release();
+    }
+
+    Arena arena; // declared first, the lists allocate from it
+    ArenaList<Vertex> vertices;
+    ArenaList<Texture> textures;
+    ArenaList<Normal> normals;
+    ArenaList<uint32_t> indices;
+};
+
+/// Appends the contents of an OBJ file to `data`. Faces may use any of the
+/// v, v/t, v//n and v/t/n forms, negative indices and more than three
+/// corners. If any face lacks normals, smooth area-weighted normals are
+/// computed for the whole file. Faces that refer to missing data are
+/// skipped. Returns false if the file cannot be read.
+bool parseObj(const std::string& fileName, ObjData& data);
+
+#endif
@@ -0,0 +1,117 @@
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+#include "particles.h"
+
+// In world units (the board spans -10..10) and seconds.
+const float GRAVITY = -30.f;
+const float MIN_SPEED = 4.f, MAX_SPEED = 12.f;
+const float MIN_LIFETIME = 0.4f, MAX_LIFETIME = 0.9f;
+
+static float* allocFloats(int n)
+{
+    return (float*) aligned_alloc(16, n * sizeof(float));
+}
+
+ParticleSystem::ParticleSystem() : mCount(0), mDropped(0)
+{
+    mX = allocFloats(CAPACITY);
+    mY = allocFloats(CAPACITY);
+    mVX = allocFloats(CAPACITY);
+    mVY = allocFloats(CAPACITY);
+    mLife = allocFloats(CAPACITY);
+    mFade = allocFloats(CAPACITY);
+    mColor = (uint8_t*) aligned_alloc(16, CAPACITY);
+
+    // the update also touches the unused tail; keep it finite
+    memset(mVX, 0, CAPACITY * sizeof(float));
+    memset(mVY, 0, CAPACITY * sizeof(float));
+    memset(mX, 0, CAPACITY * sizeof(float));
+    memset(mY, 0, CAPACITY * sizeof(float));
+    memset(mLife, 0, CAPACITY * sizeof(float));
+    memset(mFade, 0, CAPACITY * sizeof(float));
+    mRng.seed(0x5eed);
+}
+
+ParticleSystem::~ParticleSystem()
+{
+    free(mX);
+    free(mY);
+    free(mVX);
+    free(mVY);
+    free(mLife);
+    free(mFade);
+    free(mColor);
+}
+
+void ParticleSystem::emit(float x, float y, uint8_t colorId)
+{
+    int n = PER_BURST;
+    if (mCount + n > CAPACITY)
+    {
+        mDropped += mCount + n - CAPACITY;
+        n = CAPACITY - mCount;
+    }
+
+    const float toUnit = 1.f / 4294967296.f;
+    for (int i = mCount; i < mCount + n; i++)
+    {
+        float angle = mRng.next() * toUnit * 6.2831853f;
+        float speed = MIN_SPEED + (MAX_SPEED - MIN_SPEED) * (mRng.next() * toUnit);
+        mX[i] = x;
+        mY[i] = y;
+        mVX[i] = speed * cosf(angle);
+        mVY[i] = speed * sinf(angle);
+        mLife[i] = 1;
+        mFade[i] = 1.f / (MIN_LIFETIME + (MAX_LIFETIME - MIN_LIFETIME) * (mRng.next() * toUnit));
+        mColor[i] = colorId;
+    }
+    mCount += n;
+}
+
+void ParticleSystem::update(float dt)
+{
+    // integrate; the tail beyond mCount is garbage but never read back, so
+    // whole groups of four are processed without a scalar remainder
+#ifdef __SSE__
+    const __m128 vdt = _mm_set1_ps(dt);
+    const __m128 vdv = _mm_set1_ps(GRAVITY * dt);
+    for (int i = 0; i < mCount; i += 4)
+    {
+        __m128 vy = _mm_add_ps(_mm_load_ps(mVY + i), vdv);
+        _mm_store_ps(mVY + i, vy);
+        _mm_store_ps(mX + i, _mm_add_ps(_mm_load_ps(mX + i), _mm_mul_ps(_mm_load_ps(mVX + i), vdt)));
+        _mm_store_ps(mY + i, _mm_add_ps(_mm_load_ps(mY + i), _mm_mul_ps(vy, vdt)));
+        _mm_store_ps(mLife + i, _mm_sub_ps(_mm_load_ps(mLife + i), _mm_mul_ps(_mm_load_ps(mFade + i), vdt)));
+    }
+#else
+    for (int i = 0; i < mCount; i++)
+    {
+        mVY[i] += GRAVITY * dt;
+        mX[i] += mVX[i] * dt;
+        mY[i] += mVY[i] * dt;
+        mLife[i] -= mFade[i] * dt;
+    }
+#endif
+
+    // swap the dead ones out so the live particles stay packed
+    for (int i = 0; i < mCount; )
+    {
+        if (mLife[i] > 0)
+        {
+            i++;
+            continue;
+        }
+        int last = --mCount;
+        mX[i] = mX[last];
+        mY[i] = mY[last];
+        mVX[i] = mVX[last];
+        mVY[i] = mVY[last];
+        mLife[i] = mLife[last];
+        mFade[i] = mFade[last];
+        mColor[i] = mColor[last];
+    }
+}
@@ -0,0 +1,104 @@
+#ifndef PARTICLES_H
+#define PARTICLES_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include "board.h"
+
+// Particle bursts for cleared tiles.
+//
+// The simulation thread reports every tile that vanishes as a Burst through
+// a BurstQueue. The render thread drains it, turns each burst into a spray
+// of particles in its ParticleSystem, advances them by the frame time and
+// draws all of them at once.
+
+/// One cleared tile
+struct Burst
+{
+    int16_t row, col;
+    uint8_t colorId;
+};
+
+/// Lock-free single-producer / single-consumer queue; bursts that do not
+/// fit are dropped.
+class BurstQueue
+{
+public:
+    static const uint32_t CAPACITY = 4096; // must be a power of two
+
+    BurstQueue() : mHead(0), mTail(0) { }
+
+    bool push(const Burst& burst)
+    {
+        uint32_t head = mHead.load(std::memory_order_relaxed);
+        if (head - mTail.load(std::memory_order_acquire) == CAPACITY)
+            return false;
+        mBursts[head & (CAPACITY - 1)] = burst;
+        mHead.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(Burst& burst)
+    {
+        uint32_t tail = mTail.load(std::memory_order_relaxed);
+        if (tail == mHead.load(std::memory_order_acquire))
+            return false;
+        burst = mBursts[tail & (CAPACITY - 1)];
+        mTail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    alignas(64) std::atomic<uint32_t> mHead;
+    alignas(64) std::atomic<uint32_t> mTail;
+    Burst mBursts[CAPACITY];
+};
+
+/// Fixed-capacity pool of particles stored as separate arrays, one per
+/// attribute, so the update runs four particles per SSE instruction and the
+/// arrays can be uploaded to the GPU as they are. Live particles are always
+/// the first count() entries. Nothing allocates after construction.
+class ParticleSystem
+{
+public:
+    static const int CAPACITY = 65536; // multiple of 4
+    static const int PER_BURST = 48;
+
+    ParticleSystem();
+    ~ParticleSystem();
+
+    /// Sprays PER_BURST particles from (x, y). Particles beyond the
+    /// capacity are dropped.
+    void emit(float x, float y, uint8_t colorId);
+
+    /// Advances every particle by `dt` seconds and removes the dead ones.
+    void update(float dt);
+
+    void clear() { mCount = 0; }
+    int count() const { return mCount; }
+    int dropped() const { return mDropped; }
+    size_t memoryUsage() const { return CAPACITY * (6 * sizeof(float) + 1); }
+
+    // Attribute arrays, CAPACITY entries each, the first count() live.
+    const float* x() const { return mX; }
+    const float* y() const { return mY; }
+    const float* life() const { return mLife; }    // 1 at birth, fades to 0
+    const uint8_t* color() const { return mColor; } // color id
+
+private:
+    ParticleSystem(const ParticleSystem&);
+    ParticleSystem& operator=(const ParticleSystem&);
+
+    float* mX;
+    float* mY;
+    float* mVX;
+    float* mVY;
+    float* mLife;
+    float* mFade; // life lost per second
+    uint8_t* mColor;
+    int mCount, mDropped;
+    Rng mRng;
+};
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef RESOLUTION_H
+#define RESOLUTION_H
+
+#include <algorithm>
+#include <cmath>
+
+/// Picks the render scale of the board pass from its measured GPU time.
+///
+/// The cost of the pass is roughly proportional to the number of pixels,
+/// i.e. to scale squared, so each update moves the scale towards
+/// sqrt(target / time). The time is smoothed, rescaled along with the
+/// scale, and the step per frame is limited, which settles within a few
+/// frames without oscillating; inside the dead band around the target the
+/// scale is left alone.
+class ResolutionScaler
+{
+public:
+    static constexpr float MIN_SCALE = 0.25f;
+    static constexpr float MAX_SCALE = 1.0f;
+
+    ResolutionScaler() : mBudgetMs(0), mScale(MAX_SCALE), mSmoothedMs(0) { }
+
+    /// A budget of 0 disables scaling.
+    void setBudget(float ms) { mBudgetMs = ms; mScale = MAX_SCALE; mSmoothedMs = 0; }
+    bool enabled() const { return mBudgetMs > 0; }
+    float budget() const { return mBudgetMs; }
+
+    float scale() const { return mScale; }
+    float smoothedMs() const { return mSmoothedMs; }
+
+    /// Feeds the time of one board pass, in milliseconds.
+    void update(float ms)
+    {
+        if (!enabled() || ms <= 0)
+            return;
+
+        mSmoothedMs = mSmoothedMs > 0 ? mSmoothedMs + SMOOTHING * (ms - mSmoothedMs) : ms;
+
+        // aim a little under the budget so noise does not push us over it
+        float ratio = TARGET * mBudgetMs / mSmoothedMs;
+        if (ratio > 1 - DEAD_BAND && ratio < 1 + DEAD_BAND)
+            return;
+
+        float step = std::sqrt(ratio);
+        step = std::max(MAX_DOWN, std::min(MAX_UP, step));
+        float scale = std::max(MIN_SCALE, std::min(MAX_SCALE, mScale * step));
+
+        // the smoothed time still reflects the old scale; predict it for the
+        // new one so the next frames do not keep correcting the same error
+        mSmoothedMs *= (scale * scale) / (mScale * mScale);
+        mScale = scale;
+    }
+
+private:
+    static constexpr float TARGET = 0.85f;    // fraction of the budget aimed for
+    static constexpr float DEAD_BAND = 0.1f;
+    static constexpr float SMOOTHING = 0.3f;
+    static constexpr float MAX_DOWN = 0.8f;   // per-frame scale limits; dropping
+    static constexpr float MAX_UP = 1.05f;    // is faster than recovering
+
+    float mBudgetMs;
+    float mScale;
+    float mSmoothedMs;
+};
+
+#endif
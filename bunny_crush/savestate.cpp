@@ -0,0 +1,251 @@
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "board.h"
+#include "savestate.h"
+
+const int COLOR_BITS = 3; // enough for NUM_COLORS
+static_assert(NUM_COLORS <= (1 << COLOR_BITS), "colors do not fit in COLOR_BITS");
+
+// `h` continues the hash of earlier data
+static uint32_t fnv1a(const uint8_t* data, size_t size, uint32_t h = 2166136261u)
+{
+    for (size_t i = 0; i < size; i++)
+        h = (h ^ data[i]) * 16777619u;
+    return h;
+}
+
+static size_t packedSize(size_t count, int bits)
+{
+    return (count * bits + 7) / 8;
+}
+
+// Appends `count` values of `bits` bits each, LSB first. `mask` selects
+// which bits of each byte in `values` to store (shifted down by `shift`).
+static void packBits(const uint8_t* values, size_t count, int bits, uint8_t mask, int shift, std::vector<uint8_t>& out)
+{
+    uint64_t acc = 0;
+    int filled = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        acc |= (uint64_t) ((values[i] & mask) >> shift) << filled;
+        filled += bits;
+        while (filled >= 8)
+        {
+            out.push_back(acc & 0xff);
+            acc >>= 8;
+            filled -= 8;
+        }
+    }
+    if (filled > 0)
+        out.push_back(acc & 0xff);
+}
+
+// Inverse of packBits: ORs each value, shifted up by `shift`, into `values`.
+static const uint8_t* unpackBits(const uint8_t* in, size_t count, int bits, int shift, uint8_t* values)
+{
+    uint64_t acc = 0;
+    int filled = 0;
+    uint8_t mask = (1 << bits) - 1;
+    for (size_t i = 0; i < count; i++)
+    {
+        while (filled < bits)
+        {
+            acc |= (uint64_t) *in++ << filled;
+            filled += 8;
+        }
+        values[i] |= (acc & mask) << shift;
+        acc >>= bits;
+        filled -= bits;
+    }
+    return in;
+}
+
+void encodeSnapshot(const GameSnapshot& snapshot, std::vector<uint8_t>& out)
+{
+    size_t cells = (size_t) snapshot.rows * snapshot.cols;
+
+    uint8_t used = 0;
+    for (size_t i = 0; i < cells; i++)
+        used |= snapshot.flags[i];
+
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "BCSV", 4);
+    header.version = SNAPSHOT_VERSION;
+    header.flagPlanes = used;
+    header.rngState = snapshot.rngState;
+    header.rows = snapshot.rows;
+    header.cols = snapshot.cols;
+    header.event = snapshot.event;
+    header.pressRow = snapshot.pressRow;
+    header.pressCol = snapshot.pressCol;
+    header.moveCounter = snapshot.moveCounter;
+    header.numOfMatched = snapshot.numOfMatched;
+    header.angle = snapshot.angle;
+    header.scaling = snapshot.scaling;
+    header.progress = snapshot.progress;
+
+    out.clear();
+    out.reserve(sizeof(header) + packedSize(cells, COLOR_BITS) + SNAPSHOT_FLAG_COUNT * packedSize(cells, 1));
+    out.resize(sizeof(header));
+
+    packBits(&snapshot.colors[0], cells, COLOR_BITS, (1 << COLOR_BITS) - 1, 0, out);
+    for (int f = 0; f < SNAPSHOT_FLAG_COUNT; f++)
+    {
+        if (used & (1 << f))
+            packBits(&snapshot.flags[0], cells, 1, 1 << f, f, out);
+    }
+
+    // the checksum covers the header too, with the checksum itself zero
+    memcpy(&out[0], &header, sizeof(header));
+    header.checksum = fnv1a(&out[0], out.size());
+    memcpy(&out[0], &header, sizeof(header));
+}
+
+bool writeSnapshot(const std::string& fileName, const GameSnapshot& snapshot)
+{
+    std::vector<uint8_t> data;
+    encodeSnapshot(snapshot, data);
+
+    std::string tmpName = fileName + ".tmp";
+    FILE* file = fopen(tmpName.c_str(), "wb");
+    if (!file)
+        return false;
+
+    bool ok = fwrite(&data[0], 1, data.size(), file) == data.size();
+    ok = fclose(file) == 0 && ok;
+    if (!ok)
+    {
+        remove(tmpName.c_str());
+        return false;
+    }
+    return rename(tmpName.c_str(), fileName.c_str()) == 0;
+}
+
+bool loadSnapshot(const std::string& fileName, GameSnapshot& snapshot)
+{
+    int fd = open(fileName.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(SnapshotHeader))
+    {
+        close(fd);
+        return false;
+    }
+
+    size_t size = st.st_size;
+    void* map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return false;
+
+    const uint8_t* data = (const uint8_t*) map;
+    SnapshotHeader header;
+    memcpy(&header, data, sizeof(header));
+
+    bool ok = memcmp(header.magic, "BCSV", 4) == 0 && header.version == SNAPSHOT_VERSION &&
+              header.rows > 0 && header.cols > 0;
+
+    size_t cells = ok ? (size_t) header.rows * header.cols : 0;
+    if (ok)
+    {
+        size_t expected = sizeof(header) + packedSize(cells, COLOR_BITS);
+        for (int f = 0; f < SNAPSHOT_FLAG_COUNT; f++)
+            if (header.flagPlanes & (1 << f))
+                expected += packedSize(cells, 1);
+        SnapshotHeader unsummed = header;
+        unsummed.checksum = 0;
+        uint32_t checksum = fnv1a((const uint8_t*) &unsummed, sizeof(unsummed));
+        ok = size == expected && fnv1a(data + sizeof(header), size - sizeof(header), checksum) == header.checksum;
+    }
+
+    if (ok)
+    {
+        snapshot.rows = header.rows;
+        snapshot.cols = header.cols;
+        snapshot.colors.assign(cells, 0);
+        snapshot.flags.assign(cells, 0);
+
+        const uint8_t* in = unpackBits(data + sizeof(header), cells, COLOR_BITS, 0, &snapshot.colors[0]);
+        for (int f = 0; f < SNAPSHOT_FLAG_COUNT; f++)
+        {
+            if (header.flagPlanes & (1 << f))
+                in = unpackBits(in, cells, 1, f, &snapshot.flags[0]);
+        }
+
+        // the checksum does not stop a crafted file from holding colors
+        // the game has no tiles for
+        for (size_t k = 0; k < cells && ok; k++)
+            ok = snapshot.colors[k] < NUM_COLORS;
+
+        snapshot.event = header.event;
+        snapshot.pressRow = header.pressRow;
+        snapshot.pressCol = header.pressCol;
+        snapshot.moveCounter = header.moveCounter;
+        snapshot.numOfMatched = header.numOfMatched;
+        snapshot.angle = header.angle;
+        snapshot.scaling = header.scaling;
+        snapshot.progress = header.progress;
+        snapshot.rngState = header.rngState;
+    }
+
+    munmap(map, size);
+    return ok;
+}
+
+void Autosaver::start(const std::string& fileName)
+{
+    mFileName = fileName;
+    mRunning = true;
+    mWriter = std::thread(&Autosaver::writerLoop, this);
+}
+
+void Autosaver::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (!mRunning)
+            return;
+        mRunning = false;
+    }
+    mWake.notify_one();
+    mWriter.join(); // the worker writes a pending snapshot before exiting
+}
+
+void Autosaver::submit()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (!mRunning)
+            return;
+        // swapping keeps both buffers allocated for the next capture
+        std::swap(mCapture, mPendingSnapshot);
+        mPending = true;
+    }
+    mWake.notify_one();
+}
+
+void Autosaver::writerLoop()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (true)
+    {
+        mWake.wait(lock, [this] { return mPending || !mRunning; });
+        if (!mPending)
+            break;
+
+        std::swap(mPendingSnapshot, mWriting);
+        mPending = false;
+
+        lock.unlock();
+        if (!writeSnapshot(mFileName, mWriting))
+            fprintf(stderr, "Autosave to %s failed\n", mFileName.c_str());
+        lock.lock();
+    }
+}
@@ -0,0 +1,102 @@
+#ifndef SAVESTATE_H
+#define SAVESTATE_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Save-state snapshots.
+//
+// A snapshot is the complete game state: tile colors, the per-tile
+// animation flags, the animation phase and scalars, the counters and the
+// generator state. On disk it is a fixed SnapshotHeader followed by the
+// colors packed to 3 bits per tile and one bit plane per animation flag.
+// Flag planes that are all zero (the common case when the board is idle)
+// are left out.
+
+enum SnapshotFlag
+{
+    SNAPSHOT_MARKED = 1, // tile being popped (clicked or matched)
+    SNAPSHOT_FLAG_COUNT = 1,
+};
+
+struct GameSnapshot
+{
+    int32_t rows, cols;
+    std::vector<uint8_t> colors; // rows * cols color ids
+    std::vector<uint8_t> flags;  // rows * cols SnapshotFlag bits
+
+    int32_t event;
+    int32_t pressRow, pressCol;
+    int32_t moveCounter, numOfMatched;
+    float angle, scaling, progress;
+    uint64_t rngState;
+};
+
+struct SnapshotHeader
+{
+    char magic[4];      // "BCSV"
+    uint16_t version;
+    uint16_t flagPlanes; // bit i set: plane for flag (1 << i) follows the colors
+    uint64_t rngState;
+    int32_t rows, cols;
+    int32_t event;
+    int32_t pressRow, pressCol;
+    int32_t moveCounter, numOfMatched;
+    float angle, scaling, progress;
+    uint32_t checksum;   // FNV-1a of the header, with this field zero, and the payload
+    uint32_t reserved;
+};
+
+static_assert(sizeof(SnapshotHeader) == 64, "snapshot header layout changed");
+
+const uint16_t SNAPSHOT_VERSION = 3;
+
+/// Packs a snapshot into its file representation.
+void encodeSnapshot(const GameSnapshot& snapshot, std::vector<uint8_t>& out);
+
+/// Writes a snapshot next to `fileName` and renames it into place, so a
+/// crash while saving leaves the previous save intact.
+bool writeSnapshot(const std::string& fileName, const GameSnapshot& snapshot);
+
+/// Memory-maps and unpacks a snapshot. Returns false if the file is
+/// missing, truncated, corrupt, from another version or holds a color id
+/// of NUM_COLORS or more.
+bool loadSnapshot(const std::string& fileName, GameSnapshot& snapshot);
+
+/// Writes snapshots on a background thread. The game thread fills
+/// capture() and calls submit(); packing and file I/O happen on the
+/// worker. If a new snapshot arrives before the previous one was written,
+/// only the newest is kept.
+class Autosaver
+{
+public:
+    Autosaver() : mPending(false), mRunning(false) { }
+    ~Autosaver() { stop(); }
+
+    void start(const std::string& fileName);
+    void stop();
+    bool enabled() const { return mRunning; }
+
+    /// Snapshot to fill on the game thread. Its buffers are reused between
+    /// saves, so capturing does not allocate once the board size is stable.
+    GameSnapshot& capture() { return mCapture; }
+
+    /// Hands the captured snapshot to the writer.
+    void submit();
+
+private:
+    void writerLoop();
+
+    std::string mFileName;
+    GameSnapshot mCapture, mPendingSnapshot, mWriting;
+    bool mPending, mRunning;
+    std::mutex mMutex;
+    std::condition_variable mWake;
+    std::thread mWriter;
+};
+
+#endif
@@ -0,0 +1,125 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include "spectator.h"
+
+// Headless spectator. Connects to a game started with BUNNY_SPECTATE,
+// rebuilds every board from the stream and checks each message's checksum:
+//
+//   make spectate && ./spectate <[host:]port | unix:<path>> [--ticks n] [--show]
+//
+// Prints a status line every second and a summary at the end. --ticks stops
+// after n ticks, --show prints the boards on exit. The exit code is 1 if the
+// stream could not be verified.
+
+static double nowSeconds()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void printBoards(const SpectatorDecoder& decoder)
+{
+    for (size_t b = 0; b < decoder.boards().size(); b++)
+    {
+        const SpectatorBoard& board = decoder.boards()[b];
+        printf("board %zu: %dx%d, moves %d, score %d\n", b, board.cols, board.rows, board.moveCounter, board.score);
+        for (int r = 0; r < board.rows; r++)
+        {
+            for (int c = 0; c < board.cols; c++)
+                putchar('0' + board.cells[r * board.cols + c]);
+            putchar('\n');
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::string address;
+    long maxTicks = -1;
+    bool show = false, usage = false;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--ticks" && i + 1 < argc)
+            maxTicks = atol(argv[++i]);
+        else if (arg == "--show")
+            show = true;
+        else if (address.empty() && arg[0] != '-')
+            address = arg;
+        else
+            usage = true;
+    }
+
+    sockaddr_storage addr;
+    socklen_t length;
+    if (usage || address.empty() || !spectatorAddress(address, addr, length))
+    {
+        fprintf(stderr, "usage: %s <[host:]port | unix:<path>> [--ticks n] [--show]\n", argv[0]);
+        return 1;
+    }
+
+    int fd = socket(addr.ss_family, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (sockaddr*) &addr, length) != 0)
+    {
+        perror(address.c_str());
+        return 1;
+    }
+
+    SpectatorDecoder decoder;
+    uint64_t bytes = 0, lastBytes = 0;
+    uint32_t firstTick = 0;
+    bool started = false, ok = true;
+    double start = nowSeconds(), lastReport = start;
+
+    static uint8_t buffer[1 << 16];
+    while (true)
+    {
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if (n <= 0)
+        {
+            if (n < 0)
+                perror("read");
+            break;
+        }
+        bytes += n;
+        if (!decoder.feed(buffer, n))
+        {
+            fprintf(stderr, "Stream error: %s\n", decoder.error().c_str());
+            ok = false;
+            break;
+        }
+
+        if (!started && decoder.keyframes() > 0)
+        {
+            started = true;
+            firstTick = decoder.tick();
+        }
+
+        double now = nowSeconds();
+        if (now - lastReport >= 1)
+        {
+            printf("tick %u  boards %zu  deltas %llu  %.0f B/s\n", decoder.tick(), decoder.boards().size(),
+                   (unsigned long long) decoder.deltas(), (bytes - lastBytes) / (now - lastReport));
+            fflush(stdout);
+            lastBytes = bytes;
+            lastReport = now;
+        }
+
+        if (started && maxTicks >= 0 && decoder.tick() - firstTick >= maxTicks)
+            break;
+    }
+    close(fd);
+
+    if (show)
+        printBoards(decoder);
+
+    double seconds = nowSeconds() - start;
+    uint64_t messages = decoder.keyframes() + decoder.deltas();
+    printf("%s: %llu bytes in %.1f s, %llu keyframes, %llu deltas, %.1f bytes per message, ticks %u to %u\n",
+           ok ? "verified" : "FAILED", (unsigned long long) bytes, seconds, (unsigned long long) decoder.keyframes(),
+           (unsigned long long) decoder.deltas(), messages ? double(bytes) / messages : 0.0, firstTick, decoder.tick());
+    return ok && started ? 0 : 1;
+}
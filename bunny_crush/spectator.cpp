@@ -0,0 +1,690 @@
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <utility>
+#include "game.h"
+#include "spectator.h"
+
+static const size_t MAX_MESSAGE = 1 << 26; // a keyframe of a 4096x4096 board fits
+static const int MAX_BOARDS = 64;
+
+static void putVarint(std::vector<uint8_t>& out, uint32_t value)
+{
+    while (value >= 0x80)
+    {
+        out.push_back(value | 0x80);
+        value >>= 7;
+    }
+    out.push_back(value);
+}
+
+static void putSigned(std::vector<uint8_t>& out, int32_t value)
+{
+    putVarint(out, ((uint32_t) value << 1) ^ (uint32_t) (value >> 31));
+}
+
+static void putChecksum(std::vector<uint8_t>& out, uint32_t checksum)
+{
+    for (int i = 0; i < 4; i++)
+        out.push_back(checksum >> (8 * i));
+}
+
+// Returns false if the varint is cut off or longer than five bytes.
+static bool getVarint(const uint8_t*& p, const uint8_t* end, uint32_t& value)
+{
+    value = 0;
+    for (int shift = 0; shift < 35; shift += 7)
+    {
+        if (p == end)
+            return false;
+        uint8_t byte = *p++;
+        value |= (uint32_t) (byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+static bool getSigned(const uint8_t*& p, const uint8_t* end, int32_t& value)
+{
+    uint32_t zigzag;
+    if (!getVarint(p, end, zigzag))
+        return false;
+    value = (int32_t) (zigzag >> 1) ^ -(int32_t) (zigzag & 1);
+    return true;
+}
+
+uint32_t spectatorChecksum(const SpectatorBoard& board)
+{
+    // FNV-1a over the cells and then the counters
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < board.cells.size(); i++)
+        h = (h ^ board.cells[i]) * 16777619u;
+    int32_t values[] = {board.rows, board.cols, board.moveCounter, board.score, board.event, board.pressRow, board.pressCol};
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++)
+        for (int b = 0; b < 4; b++)
+            h = (h ^ (uint8_t) ((uint32_t) values[i] >> (8 * b))) * 16777619u;
+    return h;
+}
+
+bool spectatorAddress(const std::string& address, sockaddr_storage& addr, socklen_t& length)
+{
+    memset(&addr, 0, sizeof(addr));
+
+    if (address.compare(0, 5, "unix:") == 0)
+    {
+        sockaddr_un* un = (sockaddr_un*) &addr;
+        std::string path = address.substr(5);
+        if (path.empty() || path.size() >= sizeof(un->sun_path))
+            return false;
+        un->sun_family = AF_UNIX;
+        memcpy(un->sun_path, path.c_str(), path.size() + 1);
+        length = sizeof(sockaddr_un);
+        return true;
+    }
+
+    std::string host = "127.0.0.1", port = address;
+    size_t colon = address.rfind(':');
+    if (colon != std::string::npos)
+    {
+        host = address.substr(0, colon);
+        port = address.substr(colon + 1);
+    }
+
+    char* end;
+    long number = strtol(port.c_str(), &end, 10);
+    sockaddr_in* in = (sockaddr_in*) &addr;
+    in->sin_family = AF_INET;
+    in->sin_port = htons(number);
+    length = sizeof(sockaddr_in);
+    return !port.empty() && *end == 0 && number > 0 && number < 65536 && inet_pton(AF_INET, host.c_str(), &in->sin_addr) == 1;
+}
+
+// Messages are built here first so their length can be written in front.
+static thread_local std::vector<uint8_t> tPayload;
+
+static void endMessage(std::vector<uint8_t>& out)
+{
+    putVarint(out, tPayload.size());
+    out.insert(out.end(), tPayload.begin(), tPayload.end());
+}
+
+void encodeKeyframe(const SpectatorBoard& board, int index, uint32_t tick, std::vector<uint8_t>& out)
+{
+    std::vector<uint8_t>& p = tPayload;
+    p.clear();
+    p.push_back(MSG_KEYFRAME);
+    putVarint(p, index);
+    putVarint(p, tick);
+    putVarint(p, board.rows);
+    putVarint(p, board.cols);
+    putVarint(p, board.moveCounter);
+    putVarint(p, board.score);
+    putVarint(p, board.event);
+    putVarint(p, board.pressRow + 1);
+    putVarint(p, board.pressCol + 1);
+
+    for (size_t i = 0; i < board.cells.size(); )
+    {
+        size_t j = i + 1;
+        while (j < board.cells.size() && board.cells[j] == board.cells[i])
+            j++;
+        putVarint(p, j - i);
+        p.push_back(board.cells[i]);
+        i = j;
+    }
+
+    putChecksum(p, spectatorChecksum(board));
+    endMessage(out);
+}
+
+// First cell from `i` on where the boards differ, or n. Compares eight
+// cells at a time, since most of a board stays the same between ticks.
+static size_t firstDifference(const uint8_t* a, const uint8_t* b, size_t i, size_t n)
+{
+    while (i + 8 <= n)
+    {
+        uint64_t x, y;
+        memcpy(&x, a + i, 8);
+        memcpy(&y, b + i, 8);
+        if (x != y)
+            break;
+        i += 8;
+    }
+    while (i < n && a[i] == b[i])
+        i++;
+    return i;
+}
+
+bool encodeDelta(const SpectatorBoard& from, const SpectatorBoard& to, int index, uint32_t tick, std::vector<uint8_t>& out)
+{
+    if (from.rows != to.rows || from.cols != to.cols || from.cells.size() != to.cells.size())
+    {
+        encodeKeyframe(to, index, tick, out);
+        return true;
+    }
+
+    size_t n = to.cells.size();
+    size_t first = n ? firstDifference(&from.cells[0], &to.cells[0], 0, n) : 0;
+
+    int flags = 0;
+    if (from.moveCounter != to.moveCounter)
+        flags |= DELTA_MOVES;
+    if (from.score != to.score)
+        flags |= DELTA_SCORE;
+    if (from.event != to.event)
+        flags |= DELTA_EVENT;
+    if (from.pressRow != to.pressRow || from.pressCol != to.pressCol)
+        flags |= DELTA_PRESS;
+    if (first < n)
+        flags |= DELTA_CELLS;
+    if (!flags)
+        return false;
+
+    std::vector<uint8_t>& p = tPayload;
+    p.clear();
+    p.push_back(MSG_DELTA);
+    putVarint(p, index);
+    putVarint(p, tick);
+    putVarint(p, flags);
+    if (flags & DELTA_MOVES)
+        putSigned(p, to.moveCounter - from.moveCounter);
+    if (flags & DELTA_SCORE)
+        putSigned(p, to.score - from.score);
+    if (flags & DELTA_EVENT)
+        putVarint(p, to.event);
+    if (flags & DELTA_PRESS)
+    {
+        putVarint(p, to.pressRow + 1);
+        putVarint(p, to.pressCol + 1);
+    }
+
+    if (flags & DELTA_CELLS)
+    {
+        // runs of changed cells that all take the same color
+        const uint8_t* a = &from.cells[0];
+        const uint8_t* b = &to.cells[0];
+        size_t last = 0;
+        for (size_t i = first; i < n; i = firstDifference(a, b, i, n))
+        {
+            size_t j = i + 1;
+            while (j < n && a[j] != b[j] && b[j] == b[i])
+                j++;
+            putVarint(p, j - i);
+            putVarint(p, i - last);
+            p.push_back(b[i]);
+            last = i = j;
+        }
+        putVarint(p, 0);
+    }
+
+    putChecksum(p, spectatorChecksum(to));
+    endMessage(out);
+    return true;
+}
+
+bool SpectatorDecoder::fail(const std::string& error)
+{
+    mError = error;
+    return false;
+}
+
+bool SpectatorDecoder::feed(const uint8_t* data, size_t size)
+{
+    if (!mError.empty())
+        return false;
+
+    mBuffer.insert(mBuffer.end(), data, data + size);
+    const uint8_t* base = mBuffer.empty() ? NULL : &mBuffer[0];
+    const uint8_t* p = base;
+    const uint8_t* end = base + mBuffer.size();
+
+    if (!mHeaderDone)
+    {
+        if (end - p < 5)
+            return true;
+        if (memcmp(p, "BCSP", 4) != 0)
+            return fail("not a spectator stream");
+        const uint8_t* q = p + 4;
+        uint32_t version;
+        if (!getVarint(q, end, version))
+            return end - q < 5 || fail("bad header");
+        if (version != SPECTATOR_VERSION)
+            return fail("unsupported version " + std::to_string(version));
+        mHeaderDone = true;
+        p = q;
+    }
+
+    // whole messages only; a partial one waits for more bytes
+    while (p < end)
+    {
+        const uint8_t* q = p;
+        uint32_t length;
+        if (!getVarint(q, end, length))
+        {
+            if (end - p >= 5)
+                return fail("bad message length");
+            break;
+        }
+        if (length > MAX_MESSAGE)
+            return fail("message too long");
+        if ((size_t) (end - q) < length)
+            break;
+        if (!decode(q, q + length))
+            return false;
+        p = q + length;
+    }
+
+    mBuffer.erase(mBuffer.begin(), mBuffer.begin() + (p - base));
+    return true;
+}
+
+bool SpectatorDecoder::decode(const uint8_t* p, const uint8_t* end)
+{
+    if (p == end)
+        return fail("empty message");
+    uint8_t type = *p++;
+
+    uint32_t index, tick;
+    if (!getVarint(p, end, index) || !getVarint(p, end, tick))
+        return fail("truncated message");
+    if (index >= (uint32_t) MAX_BOARDS)
+        return fail("board index out of range");
+
+    if (type == MSG_KEYFRAME)
+    {
+        if (mBoards.size() <= index)
+            mBoards.resize(index + 1);
+        SpectatorBoard& board = mBoards[index];
+
+        uint32_t rows, cols, moves, score, event, pressRow, pressCol;
+        if (!getVarint(p, end, rows) || !getVarint(p, end, cols) || !getVarint(p, end, moves) ||
+            !getVarint(p, end, score) || !getVarint(p, end, event) || !getVarint(p, end, pressRow) ||
+            !getVarint(p, end, pressCol))
+            return fail("truncated keyframe");
+        if ((uint64_t) rows * cols > MAX_MESSAGE)
+            return fail("board too large");
+
+        board.rows = rows;
+        board.cols = cols;
+        board.moveCounter = moves;
+        board.score = score;
+        board.event = event;
+        board.pressRow = (int) pressRow - 1;
+        board.pressCol = (int) pressCol - 1;
+        board.cells.resize((size_t) rows * cols);
+
+        size_t filled = 0;
+        while (filled < board.cells.size())
+        {
+            uint32_t count;
+            if (!getVarint(p, end, count) || p == end)
+                return fail("truncated keyframe");
+            if (count == 0 || count > board.cells.size() - filled)
+                return fail("keyframe run out of range");
+            memset(&board.cells[filled], *p++, count);
+            filled += count;
+        }
+        mKeyframes++;
+    }
+    else if (type == MSG_DELTA)
+    {
+        if (index >= mBoards.size() || mBoards[index].rows == 0)
+            return fail("delta before keyframe");
+        SpectatorBoard& board = mBoards[index];
+
+        uint32_t flags;
+        if (!getVarint(p, end, flags))
+            return fail("truncated delta");
+
+        int32_t change;
+        uint32_t value;
+        if (flags & DELTA_MOVES)
+        {
+            if (!getSigned(p, end, change))
+                return fail("truncated delta");
+            board.moveCounter += change;
+        }
+        if (flags & DELTA_SCORE)
+        {
+            if (!getSigned(p, end, change))
+                return fail("truncated delta");
+            board.score += change;
+        }
+        if (flags & DELTA_EVENT)
+        {
+            if (!getVarint(p, end, value))
+                return fail("truncated delta");
+            board.event = value;
+        }
+        if (flags & DELTA_PRESS)
+        {
+            uint32_t row, col;
+            if (!getVarint(p, end, row) || !getVarint(p, end, col))
+                return fail("truncated delta");
+            board.pressRow = (int) row - 1;
+            board.pressCol = (int) col - 1;
+        }
+        if (flags & DELTA_CELLS)
+        {
+            size_t i = 0;
+            while (true)
+            {
+                uint32_t count, skip;
+                if (!getVarint(p, end, count))
+                    return fail("truncated delta");
+                if (count == 0)
+                    break;
+                if (!getVarint(p, end, skip) || p == end)
+                    return fail("truncated delta");
+                i += skip;
+                if (i > board.cells.size() || count > board.cells.size() - i)
+                    return fail("delta segment out of range");
+                memset(&board.cells[i], *p++, count);
+                i += count;
+            }
+        }
+        mDeltas++;
+    }
+    else
+    {
+        return fail("unknown message type " + std::to_string(type));
+    }
+
+    if (end - p != 4)
+        return fail("bad message size");
+    uint32_t checksum = p[0] | p[1] << 8 | p[2] << 16 | (uint32_t) p[3] << 24;
+    if (checksum != spectatorChecksum(mBoards[index]))
+        return fail("checksum mismatch on board " + std::to_string(index) + " at tick " + std::to_string(tick));
+
+    mTick = tick;
+    return true;
+}
+
+static bool setNonBlocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+bool SpectatorServer::start(const std::string& address)
+{
+    sockaddr_storage addr;
+    socklen_t length;
+    if (mRunning || !spectatorAddress(address, addr, length))
+        return false;
+
+    mListen = socket(addr.ss_family, SOCK_STREAM, 0);
+    if (mListen < 0)
+        return false;
+
+    const char* unixPath = addr.ss_family == AF_UNIX ? ((sockaddr_un*) &addr)->sun_path : NULL;
+    if (unixPath)
+    {
+        // replace a socket left over from a previous run, but nothing else
+        struct stat st;
+        if (lstat(unixPath, &st) == 0)
+        {
+            if (!S_ISSOCK(st.st_mode))
+            {
+                fprintf(stderr, "%s exists and is not a socket\n", unixPath);
+                closeSockets();
+                return false;
+            }
+            unlink(unixPath);
+        }
+    }
+    else
+    {
+        int on = 1;
+        setsockopt(mListen, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    }
+
+    if (bind(mListen, (sockaddr*) &addr, length) != 0)
+    {
+        closeSockets();
+        return false;
+    }
+    if (unixPath)
+        mUnixPath = unixPath; // ours now, removed again by closeSockets()
+
+    if (listen(mListen, 16) != 0 || !setNonBlocking(mListen) || pipe(mWake) != 0 || !setNonBlocking(mWake[0]) ||
+        !setNonBlocking(mWake[1]))
+    {
+        closeSockets();
+        return false;
+    }
+
+    mRunning = true;
+    mThread = std::thread(&SpectatorServer::loop, this);
+    return true;
+}
+
+void SpectatorServer::stop()
+{
+    if (!mRunning)
+        return;
+
+    mRunning.store(false, std::memory_order_release);
+    char wake = 0;
+    ssize_t written = write(mWake[1], &wake, 1);
+    (void) written;
+    mThread.join();
+
+    while (!mClients.empty())
+        drop(mClients.size() - 1);
+    closeSockets();
+}
+
+void SpectatorServer::closeSockets()
+{
+    int* fds[] = {&mListen, &mWake[0], &mWake[1]};
+    for (int i = 0; i < 3; i++)
+    {
+        if (*fds[i] >= 0)
+            ::close(*fds[i]);
+        *fds[i] = -1;
+    }
+    if (!mUnixPath.empty())
+        unlink(mUnixPath.c_str());
+    mUnixPath.clear();
+}
+
+void SpectatorServer::publish(const Game* games, int numGames)
+{
+    SpectatorFrame& frame = mFrames.back();
+    frame.tick = ++mTick;
+    frame.boards.resize(numGames);
+    for (int i = 0; i < numGames; i++)
+    {
+        const Game& game = games[i];
+        SpectatorBoard& board = frame.boards[i];
+        board.rows = game.rows;
+        board.cols = game.cols;
+        board.moveCounter = game.moveCounter;
+        board.score = game.numOfMatched;
+        board.event = game.event;
+        board.pressRow = game.pressRow;
+        board.pressCol = game.pressCol;
+        board.cells = game.cells; // reuses the buffer once the size is stable
+    }
+    mFrames.publish();
+
+    // without viewers the server only looks at the newest frame when
+    // someone connects
+    if (mViewers.load(std::memory_order_relaxed) > 0)
+    {
+        char wake = 0;
+        ssize_t written = write(mWake[1], &wake, 1); // a full pipe is already awake
+        (void) written;
+    }
+}
+
+void SpectatorServer::loop()
+{
+    std::vector<pollfd> fds;
+    while (mRunning.load(std::memory_order_acquire))
+    {
+        fds.clear();
+        pollfd wake = {mWake[0], POLLIN, 0};
+        pollfd listener = {mListen, POLLIN, 0};
+        fds.push_back(wake);
+        fds.push_back(listener);
+        for (size_t i = 0; i < mClients.size(); i++)
+        {
+            pollfd client = {mClients[i].fd, (short) (POLLIN | (mClients[i].out.empty() ? 0 : POLLOUT)), 0};
+            fds.push_back(client);
+        }
+
+        if (poll(&fds[0], fds.size(), -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("spectator poll");
+            break;
+        }
+
+        if (fds[0].revents & POLLIN)
+        {
+            char drain[64];
+            while (read(mWake[0], drain, sizeof(drain)) > 0)
+            {
+            }
+        }
+
+        // backwards, so dropping a viewer only moves one already handled
+        for (size_t i = mClients.size(); i-- > 0; )
+        {
+            short revents = fds[i + 2].revents;
+            bool gone = (revents & (POLLERR | POLLHUP | POLLNVAL)) != 0;
+            if (!gone && (revents & POLLIN))
+            {
+                // viewers have nothing to say; this only notices them leaving
+                char ignored[256];
+                ssize_t n = recv(mClients[i].fd, ignored, sizeof(ignored), 0);
+                gone = n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR);
+            }
+            if (!gone && (revents & POLLOUT))
+                gone = !flush(mClients[i]);
+            if (gone)
+                drop(i);
+        }
+
+        broadcast();
+
+        if (fds[1].revents & POLLIN)
+            acceptViewers();
+    }
+}
+
+void SpectatorServer::broadcast()
+{
+    const SpectatorFrame& frame = mFrames.latest();
+    if (frame.tick == mSent.tick)
+        return;
+
+    // one encoding per tick, shared by every viewer
+    mMessages.clear();
+    for (size_t b = 0; b < frame.boards.size(); b++)
+    {
+        if (b < mSent.boards.size())
+            encodeDelta(mSent.boards[b], frame.boards[b], b, frame.tick, mMessages);
+        else
+            encodeKeyframe(frame.boards[b], b, frame.tick, mMessages);
+    }
+    mSent = frame;
+
+    if (mMessages.empty())
+        return;
+
+    for (size_t i = mClients.size(); i-- > 0; )
+    {
+        Viewer& viewer = mClients[i];
+        viewer.out.insert(viewer.out.end(), mMessages.begin(), mMessages.end());
+        if (viewer.out.size() - viewer.sent > MAX_QUEUED)
+        {
+            fprintf(stderr, "Spectator fell too far behind, disconnected\n");
+            drop(i);
+        }
+        else if (!flush(viewer))
+        {
+            drop(i);
+        }
+    }
+}
+
+void SpectatorServer::acceptViewers()
+{
+    while (true)
+    {
+        int fd = ::accept(mListen, NULL, NULL);
+        if (fd < 0)
+            return; // no more waiting, or the viewer already gave up
+
+        if (!setNonBlocking(fd))
+        {
+            ::close(fd);
+            continue;
+        }
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on)); // fails harmlessly on Unix sockets
+
+        Viewer viewer;
+        viewer.fd = fd;
+        viewer.sent = 0;
+        viewer.out.insert(viewer.out.end(), "BCSP", "BCSP" + 4);
+        putVarint(viewer.out, SPECTATOR_VERSION);
+        for (size_t b = 0; b < mSent.boards.size(); b++)
+            encodeKeyframe(mSent.boards[b], b, mSent.tick, viewer.out);
+
+        mClients.push_back(viewer);
+        mViewers.store(mClients.size(), std::memory_order_relaxed);
+        if (!flush(mClients.back()))
+            drop(mClients.size() - 1);
+    }
+}
+
+bool SpectatorServer::flush(Viewer& viewer)
+{
+    while (viewer.sent < viewer.out.size())
+    {
+        ssize_t n = send(viewer.fd, &viewer.out[viewer.sent], viewer.out.size() - viewer.sent, MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                return false;
+
+            // the socket is full; keep the rest for POLLOUT
+            if (viewer.sent > viewer.out.size() / 2)
+            {
+                viewer.out.erase(viewer.out.begin(), viewer.out.begin() + viewer.sent);
+                viewer.sent = 0;
+            }
+            return true;
+        }
+        viewer.sent += n;
+        mBytesSent.fetch_add(n, std::memory_order_relaxed);
+    }
+    viewer.out.clear();
+    viewer.sent = 0;
+    return true;
+}
+
+void SpectatorServer::drop(size_t i)
+{
+    ::close(mClients[i].fd);
+    std::swap(mClients[i], mClients.back());
+    mClients.pop_back();
+    mViewers.store(mClients.size(), std::memory_order_relaxed);
+}
@@ -0,0 +1,170 @@
+#ifndef SPECTATOR_H
+#define SPECTATOR_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <vector>
+#include "triplebuffer.h"
+
+struct Game;
+
+// Live spectator stream.
+//
+// The simulation thread publishes the logical state of every board once per
+// tick through a TripleBuffer. A SpectatorServer thread runs a single poll()
+// loop over the listening socket and all viewers: it diffs the newest state
+// against what it sent last, encodes the delta once and appends the same
+// bytes to every viewer's queue, so each viewer only costs a copy and a
+// send(). New viewers get a keyframe of every board first.
+//
+// Wire format: the magic "BCSP" and a version, then messages, each a varint
+// payload length followed by the payload. Numbers are LEB128 varints, signed
+// ones zigzag encoded; pressRow / pressCol are sent plus one so -1 fits.
+//
+//   keyframe: MSG_KEYFRAME board tick rows cols moveCounter score event
+//             pressRow pressCol {count color}... checksum
+//   delta:    MSG_DELTA board tick flags [moveCounter delta] [score delta]
+//             [event] [pressRow pressCol] [{count skip color}... 0] checksum
+//
+// Keyframe runs cover the board in row-major order. A delta segment skips
+// `skip` unchanged cells and then sets `count` cells to `color`. The
+// checksum is spectatorChecksum() of the board after the message, as four
+// little-endian bytes, so a client can verify what it reconstructed.
+
+const uint32_t SPECTATOR_VERSION = 1;
+
+enum SpectatorMessage
+{
+    MSG_KEYFRAME = 1,
+    MSG_DELTA = 2,
+};
+
+enum SpectatorDeltaFlags
+{
+    DELTA_MOVES = 1,
+    DELTA_SCORE = 2,
+    DELTA_EVENT = 4,
+    DELTA_PRESS = 8,
+    DELTA_CELLS = 16,
+};
+
+/// What a spectator sees of one board
+struct SpectatorBoard
+{
+    SpectatorBoard() : rows(0), cols(0), moveCounter(0), score(0), event(0), pressRow(-1), pressCol(-1) { }
+
+    int rows, cols;
+    int moveCounter, score;
+    int event; // GameEvent, for following the animation
+    int pressRow, pressCol;
+    std::vector<uint8_t> cells; // color ids, row-major
+};
+
+uint32_t spectatorChecksum(const SpectatorBoard& board);
+
+/// Parses "[host:]port" (TCP, host defaults to 127.0.0.1) or "unix:<path>".
+bool spectatorAddress(const std::string& address, sockaddr_storage& addr, socklen_t& length);
+
+/// Appends a keyframe message for `board`.
+void encodeKeyframe(const SpectatorBoard& board, int index, uint32_t tick, std::vector<uint8_t>& out);
+
+/// Appends a delta message from `from` to `to`, or a keyframe if the board
+/// size changed. Appends nothing and returns false if nothing changed.
+bool encodeDelta(const SpectatorBoard& from, const SpectatorBoard& to, int index, uint32_t tick, std::vector<uint8_t>& out);
+
+/// Rebuilds the boards from a stream. Bytes can be fed in pieces of any
+/// size.
+class SpectatorDecoder
+{
+public:
+    SpectatorDecoder() : mHeaderDone(false), mTick(0), mKeyframes(0), mDeltas(0) { }
+
+    /// Returns false, with error() set, on a malformed stream or a checksum
+    /// mismatch. The decoder is unusable afterwards.
+    bool feed(const uint8_t* data, size_t size);
+
+    const std::vector<SpectatorBoard>& boards() const { return mBoards; }
+    uint32_t tick() const { return mTick; }
+    uint64_t keyframes() const { return mKeyframes; }
+    uint64_t deltas() const { return mDeltas; }
+    const std::string& error() const { return mError; }
+
+private:
+    bool decode(const uint8_t* p, const uint8_t* end);
+    bool fail(const std::string& error);
+
+    std::vector<uint8_t> mBuffer; // unparsed bytes
+    bool mHeaderDone;
+    std::vector<SpectatorBoard> mBoards;
+    uint32_t mTick;
+    uint64_t mKeyframes, mDeltas;
+    std::string mError;
+};
+
+/// State of all boards after one tick
+struct SpectatorFrame
+{
+    SpectatorFrame() : tick(0) { }
+
+    uint32_t tick;
+    std::vector<SpectatorBoard> boards;
+};
+
+/// Serves the stream to any number of viewers from one thread with
+/// non-blocking sockets.
+class SpectatorServer
+{
+public:
+    static const size_t MAX_QUEUED = 1 << 20; // bytes; slower viewers are disconnected
+
+    SpectatorServer() : mRunning(false), mListen(-1), mTick(0), mViewers(0), mBytesSent(0) { mWake[0] = mWake[1] = -1; }
+    ~SpectatorServer() { stop(); }
+
+    /// Listens on a spectatorAddress() and starts the server thread.
+    /// Returns false if the socket cannot be opened.
+    bool start(const std::string& address);
+    void stop();
+    bool enabled() const { return mRunning; }
+
+    /// Called by the simulation thread after every tick. Never blocks.
+    void publish(const Game* games, int numGames);
+
+    int viewers() const { return mViewers.load(std::memory_order_relaxed); }
+    uint64_t bytesSent() const { return mBytesSent.load(std::memory_order_relaxed); }
+
+private:
+    struct Viewer
+    {
+        int fd;
+        std::vector<uint8_t> out; // queued bytes, the first `sent` already written
+        size_t sent;
+    };
+
+    void loop();
+    void acceptViewers();
+    void broadcast();
+    bool flush(Viewer& viewer); // false if the viewer is gone
+    void drop(size_t i);
+    void closeSockets();
+
+    std::thread mThread;
+    std::atomic<bool> mRunning;
+    int mListen, mWake[2]; // the simulation thread writes to mWake[1] after publishing
+    std::string mUnixPath;
+
+    TripleBuffer<SpectatorFrame> mFrames;
+    uint32_t mTick; // simulation thread
+
+    // server thread only
+    std::vector<Viewer> mClients;
+    SpectatorFrame mSent;           // what every viewer has been sent
+    std::vector<uint8_t> mMessages; // encoded once per tick for everyone
+
+    std::atomic<int> mViewers;
+    std::atomic<uint64_t> mBytesSent;
+};
+
+#endif
@@ -0,0 +1,184 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+// Gameplay telemetry.
+//
+// Each producing thread pushes fixed-size binary events into its own
+// single-producer / single-consumer ring buffer; a background thread drains
+// the rings into a log file. Pushing never blocks and never touches stdio:
+// if the writer falls behind the event is dropped and counted instead.
+// Events from different producers are interleaved in the log in batches;
+// sort by time if order matters.
+//
+// Log layout: a TelemetryHeader followed by TelemetryEvent records.
+// telemetry_decode turns a log into CSV.
+
+enum TelemetryType
+{
+    TELEMETRY_MOVE = 1,    // a = row, b = column of the clicked tile
+    TELEMETRY_MATCH = 2,   // a = number of matched tiles
+    TELEMETRY_CASCADE = 3, // a = match rounds triggered by the last move
+    TELEMETRY_SCORE = 4,   // a = moves so far, b = score delta
+    TELEMETRY_FRAME = 5,   // b = frame time in microseconds
+    TELEMETRY_SHUFFLE = 6, // a = moves so far; the board had no productive move
+    TELEMETRY_INPUT = 7,   // a = clicks still pending, b = microseconds the click waited
+    TELEMETRY_LATENCY = 8, // b = microseconds from an input event to the swap of the first frame after it
+};
+
+struct TelemetryEvent
+{
+    uint64_t timeUs; // microseconds since telemetry was started
+    uint8_t type;    // TelemetryType
+    uint8_t reserved;
+    uint16_t a;
+    uint32_t b;
+};
+
+static_assert(sizeof(TelemetryEvent) == 16, "telemetry records must stay 16 bytes");
+
+struct TelemetryHeader
+{
+    char magic[4];      // "BCTL"
+    uint16_t version;
+    uint16_t eventSize; // sizeof(TelemetryEvent)
+};
+
+const uint16_t TELEMETRY_VERSION = 1;
+
+/// One ring per producing thread
+enum TelemetryProducer
+{
+    TELEMETRY_SIMULATION = 0,
+    TELEMETRY_RENDER = 1,
+    TELEMETRY_PRODUCERS = 2,
+};
+
+class Telemetry
+{
+public:
+    static const uint32_t CAPACITY = 1 << 14; // events, must be a power of two
+
+    Telemetry() : mFile(NULL), mRunning(false), mDropped(0) { }
+    ~Telemetry() { stop(); }
+
+    /// Opens the log and starts the writer thread. Returns false if the
+    /// file cannot be created; pushes are ignored in that case.
+    bool start(const char* fileName)
+    {
+        mFile = fopen(fileName, "wb");
+        if (!mFile)
+            return false;
+
+        TelemetryHeader header;
+        memcpy(header.magic, "BCTL", 4);
+        header.version = TELEMETRY_VERSION;
+        header.eventSize = sizeof(TelemetryEvent);
+        fwrite(&header, sizeof(header), 1, mFile);
+
+        mStart = std::chrono::steady_clock::now();
+        mRunning.store(true, std::memory_order_release);
+        mWriter = std::thread(&Telemetry::writerLoop, this);
+        return true;
+    }
+
+    /// Flushes whatever is left in the ring and closes the log.
+    void stop()
+    {
+        if (!mRunning.exchange(false))
+            return;
+        mWriter.join();
+        drain();
+        fclose(mFile);
+        mFile = NULL;
+    }
+
+    bool enabled() const { return mRunning.load(std::memory_order_relaxed); }
+    uint64_t dropped() const { return mDropped.load(std::memory_order_relaxed); }
+
+    /// Producer side. Each producer must only be used from one thread.
+    void push(uint8_t type, uint16_t a, uint32_t b, int producer = TELEMETRY_SIMULATION)
+    {
+        if (!enabled())
+            return;
+
+        Ring& ring = mRings[producer];
+        uint32_t head = ring.head.load(std::memory_order_relaxed);
+        if (head - ring.tail.load(std::memory_order_acquire) == CAPACITY)
+        {
+            mDropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        TelemetryEvent& e = ring.events[head & (CAPACITY - 1)];
+        e.timeUs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - mStart).count();
+        e.type = type;
+        e.reserved = 0;
+        e.a = a;
+        e.b = b;
+        ring.head.store(head + 1, std::memory_order_release);
+    }
+
+private:
+    struct Ring
+    {
+        Ring() : head(0), tail(0) { }
+
+        // head and tail are written by different threads; keep them on
+        // separate cache lines
+        alignas(64) std::atomic<uint32_t> head;
+        alignas(64) std::atomic<uint32_t> tail;
+        TelemetryEvent events[CAPACITY];
+    };
+
+    // Consumer side: writes every published event, in at most two
+    // contiguous chunks per ring, and releases the slots.
+    size_t drain()
+    {
+        size_t total = 0;
+        for (int p = 0; p < TELEMETRY_PRODUCERS; p++)
+        {
+            Ring& ring = mRings[p];
+            uint32_t tail = ring.tail.load(std::memory_order_relaxed);
+            uint32_t head = ring.head.load(std::memory_order_acquire);
+            uint32_t count = head - tail;
+            if (count == 0)
+                continue;
+
+            uint32_t first = tail & (CAPACITY - 1);
+            uint32_t chunk = count < CAPACITY - first ? count : CAPACITY - first;
+            fwrite(&ring.events[first], sizeof(TelemetryEvent), chunk, mFile);
+            if (chunk < count)
+                fwrite(&ring.events[0], sizeof(TelemetryEvent), count - chunk, mFile);
+
+            ring.tail.store(head, std::memory_order_release);
+            total += count;
+        }
+        return total;
+    }
+
+    void writerLoop()
+    {
+        while (mRunning.load(std::memory_order_acquire))
+        {
+            if (drain() == 0)
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    }
+
+    FILE* mFile;
+    std::thread mWriter;
+    std::atomic<bool> mRunning;
+    std::chrono::steady_clock::time_point mStart;
+
+    alignas(64) std::atomic<uint64_t> mDropped;
+    Ring mRings[TELEMETRY_PRODUCERS];
+};
+
+#endif
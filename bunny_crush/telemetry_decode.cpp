@@ -0,0 +1,67 @@
+#include <cstdio>
+#include <cstring>
+#include "telemetry.h"
+
+// Converts a telemetry log written by the game into CSV on stdout.
+//
+//   ./telemetry_decode <log_file> > play.csv
+
+static const char* typeName(uint8_t type)
+{
+    switch (type)
+    {
+        case TELEMETRY_MOVE: return "move";
+        case TELEMETRY_MATCH: return "match";
+        case TELEMETRY_CASCADE: return "cascade";
+        case TELEMETRY_SCORE: return "score";
+        case TELEMETRY_FRAME: return "frame";
+        case TELEMETRY_SHUFFLE: return "shuffle";
+        case TELEMETRY_INPUT: return "input";
+        case TELEMETRY_LATENCY: return "latency";
+    }
+    return "unknown";
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 2)
+    {
+        fprintf(stderr, "Please run the program as:\n\t./telemetry_decode <log_file>\n");
+        return 1;
+    }
+
+    FILE* file = fopen(argv[1], "rb");
+    if (!file)
+    {
+        fprintf(stderr, "Cannot open %s\n", argv[1]);
+        return 1;
+    }
+
+    TelemetryHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, "BCTL", 4) != 0)
+    {
+        fprintf(stderr, "%s is not a telemetry log\n", argv[1]);
+        return 1;
+    }
+    if (header.version != TELEMETRY_VERSION || header.eventSize != sizeof(TelemetryEvent))
+    {
+        fprintf(stderr, "Unsupported telemetry version %d\n", header.version);
+        return 1;
+    }
+
+    printf("time_us,type,a,b\n");
+
+    TelemetryEvent events[1024];
+    size_t count;
+    while ((count = fread(events, sizeof(TelemetryEvent), 1024, file)) > 0)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            printf("%llu,%s,%u,%u\n", (unsigned long long) events[i].timeUs,
+                   typeName(events[i].type), events[i].a, events[i].b);
+        }
+    }
+
+    fclose(file);
+    return 0;
+}
@@ -0,0 +1,115 @@
+#include "trace.h"
+
+#ifdef BUNNY_TRACE
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+struct TraceEvent
+{
+    const char* name;
+    uint64_t startNs, endNs;
+};
+
+/// The newest events of one thread. Only its own thread writes to it; a
+/// dump reads it concurrently and drops what may have been overwritten.
+struct TraceBuffer
+{
+    static const uint32_t CAPACITY = 1 << 16; // must be a power of two
+
+    TraceEvent events[CAPACITY];
+    std::atomic<uint64_t> head; // events ever recorded
+    std::atomic<const char*> name;
+    int tid;
+};
+
+// Buffers outlive their threads so a dump at exit still has them.
+static std::mutex gTraceMutex;
+static std::vector<TraceBuffer*> gTraceBuffers;
+static const uint64_t gTraceEpochNs = TraceZone::traceNowNs();
+
+static TraceBuffer* threadBuffer()
+{
+    static thread_local TraceBuffer* buffer = NULL;
+    if (!buffer)
+    {
+        buffer = new TraceBuffer();
+        buffer->head = 0;
+        buffer->name = NULL;
+        std::lock_guard<std::mutex> lock(gTraceMutex);
+        buffer->tid = gTraceBuffers.size() + 1;
+        gTraceBuffers.push_back(buffer);
+    }
+    return buffer;
+}
+
+void TraceZone::traceRecord(const char* name, uint64_t startNs, uint64_t endNs)
+{
+    TraceBuffer* buffer = threadBuffer();
+    uint64_t head = buffer->head.load(std::memory_order_relaxed);
+    TraceEvent& event = buffer->events[head & (TraceBuffer::CAPACITY - 1)];
+    event.name = name;
+    event.startNs = startNs;
+    event.endNs = endNs;
+    buffer->head.store(head + 1, std::memory_order_release);
+}
+
+void traceThreadName(const char* name)
+{
+    threadBuffer()->name.store(name, std::memory_order_relaxed);
+}
+
+bool traceDump(const char* fileName)
+{
+    std::vector<TraceBuffer*> buffers;
+    {
+        std::lock_guard<std::mutex> lock(gTraceMutex);
+        buffers = gTraceBuffers;
+    }
+
+    FILE* file = fopen(fileName, "w");
+    if (!file)
+        return false;
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    std::vector<TraceEvent> events;
+    for (size_t b = 0; b < buffers.size(); b++)
+    {
+        TraceBuffer* buffer = buffers[b];
+        const char* name = buffer->name.load(std::memory_order_relaxed);
+        if (name)
+        {
+            fprintf(file, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                    first ? "" : ",\n", buffer->tid, name);
+            first = false;
+        }
+
+        // copy first, then keep only what cannot have been overwritten
+        // while copying
+        const uint64_t cap = TraceBuffer::CAPACITY;
+        uint64_t end = buffer->head.load(std::memory_order_acquire);
+        uint64_t begin = end > cap ? end - cap : 0;
+        events.resize(end - begin);
+        for (uint64_t i = begin; i < end; i++)
+            events[i - begin] = buffer->events[i & (cap - 1)];
+        uint64_t now = buffer->head.load(std::memory_order_acquire);
+        uint64_t safe = now + 1 > cap ? now + 1 - cap : 0;
+
+        for (uint64_t i = std::max(begin, safe); i < end; i++)
+        {
+            const TraceEvent& e = events[i - begin];
+            fprintf(file, "%s{\"ph\":\"X\",\"name\":\"%s\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                    first ? "" : ",\n", e.name, buffer->tid, (e.startNs - gTraceEpochNs) * 1e-3,
+                    (e.endNs - e.startNs) * 1e-3);
+            first = false;
+        }
+    }
+    fprintf(file, "\n]}\n");
+    return fclose(file) == 0;
+}
+
+#endif
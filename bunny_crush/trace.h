@@ -0,0 +1,61 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <chrono>
+#include <cstdint>
+
+// Scoped trace zones.
+//
+// TRACE_ZONE("name") times the rest of the enclosing block. Each thread
+// records its zones into its own ring buffer, so recording takes no lock;
+// traceDump() writes the newest events of every thread as Chrome trace
+// JSON, which Perfetto and chrome://tracing can open.
+//
+// Zones only exist in builds with BUNNY_TRACE defined (make trace). In
+// other builds the macros expand to nothing and trace.cpp is empty.
+
+#ifdef BUNNY_TRACE
+
+/// Times its own lifetime. `name` must be a string literal.
+class TraceZone
+{
+public:
+    explicit TraceZone(const char* name) : mName(name), mStart(traceNowNs()) { }
+    ~TraceZone() { traceRecord(mName, mStart, traceNowNs()); }
+
+    static uint64_t traceNowNs()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static void traceRecord(const char* name, uint64_t startNs, uint64_t endNs);
+
+private:
+    const char* mName;
+    uint64_t mStart;
+};
+
+/// Names the calling thread in the trace.
+void traceThreadName(const char* name);
+
+/// Writes the recorded events to `fileName`. Safe to call while other
+/// threads keep recording; events they overwrite during the dump are left
+/// out. Returns false if the file cannot be written.
+bool traceDump(const char* fileName);
+
+#define TRACE_CONCAT2(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+#define TRACE_ZONE(name) TraceZone TRACE_CONCAT(traceZone, __COUNTER__)(name)
+#define TRACE_THREAD(name) traceThreadName(name)
+#define TRACE_ENABLED 1
+
+#else
+
+#define TRACE_ZONE(name) ((void) 0)
+#define TRACE_THREAD(name) ((void) 0)
+#define TRACE_ENABLED 0
+
+#endif
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include "game.h"
+
+/// Scale of a resting tile's model on a board of this size.
+inline float tileScale(const BoardFrame& frame)
+{
+    float scaling2 = 30.f;
+    return scaling2/(frame.rows*frame.cols);
+}
+
+/// Modeling matrix of the tile in column j. The board spans -10..10
+/// horizontally and leaves the bottom unit of the view for the score.
+inline glm::mat4 tileModel(const BoardFrame& frame, int j, const TileView& tile)
+{
+    float gridX = 20/float(frame.cols);
+    float gridY = 19/float(frame.rows);
+
+    float scaling = tile.scale * tileScale(frame);
+
+    glm::mat4 S = glm::scale(glm::mat4(1.f), glm::vec3(scaling, scaling, scaling));
+    glm::mat4 T = glm::translate(glm::mat4(1.f), glm::vec3(-10.f + j * (gridX)+ gridX/2, 10.f - (tile.row * (gridY) + gridY/2), -10.f));
+    glm::mat4 R = glm::rotate(glm::mat4(1.f), glm::radians(frame.angle), glm::vec3(0, 1, 0));
+    return T * R * S;
+}
+
+/// tileModel() and its inverse transpose for the normals.
+inline void tileTransform(const BoardFrame& frame, int j, const TileView& tile, glm::mat4& modelMat, glm::mat4& modelMatInvTr)
+{
+    modelMat = tileModel(frame, j, tile);
+    modelMatInvTr = glm::transpose(glm::inverse(modelMat));
+}
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+#include <atomic>
+
+/// Lock-free triple buffer for one writer and one reader.
+///
+/// The writer fills back() and publish()es it; the reader calls latest()
+/// to get the most recently published buffer. Neither side ever waits: the
+/// writer always has a free buffer and the reader keeps using its current
+/// buffer until a newer one is published.
+template <typename T>
+class TripleBuffer
+{
+public:
+    TripleBuffer() : mBack(0), mMiddle(1), mFront(2) { }
+
+    /// Writer side
+    T& back() { return mBuffers[mBack]; }
+
+    void publish()
+    {
+        mBack = mMiddle.exchange(mBack | FRESH, std::memory_order_acq_rel) & INDEX;
+    }
+
+    /// Reader side. The returned buffer stays valid until the next call.
+    const T& latest()
+    {
+        if (mMiddle.load(std::memory_order_relaxed) & FRESH)
+            mFront = mMiddle.exchange(mFront, std::memory_order_acq_rel) & INDEX;
+        return mBuffers[mFront];
+    }
+
+    /// Gives the writer access to all buffers, e.g. to size them up front.
+    /// Only safe before both sides start running.
+    T& buffer(int i) { return mBuffers[i]; }
+
+private:
+    enum { INDEX = 3, FRESH = 4 };
+
+    T mBuffers[3];
+    int mBack;                 // owned by the writer
+    alignas(64) std::atomic<int> mMiddle; // index of the shared buffer, FRESH if unread
+    alignas(64) int mFront;    // owned by the reader
+};
+
+#endif
@@ -16,6 +16,7 @@ uniform vec3 kd;
 uniform mat4 modelingMat;
 uniform mat4 modelingMatInvTr;
 uniform mat4 orthoMat;
+uniform vec4 region; // split screen: clip space offset (xy) and scale (zw)
 
 attribute vec3 inVertex;
 attribute vec3 inNormal;
@@ -42,4 +43,5 @@ void main(void)
 	gl_FrontColor = vec4(diffuseColor + ambientColor + specularColor, 1);
 
     gl_Position = orthoMat * modelingMat * vec4(inVertex, 1);
+    gl_Position.xy = gl_Position.xy * region.zw + region.xy * gl_Position.w;
 }
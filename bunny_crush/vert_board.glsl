@@ -0,0 +1,23 @@
+#version 430
+
+// One point per cell of a GPU board, see gpuboard.h. The colors are read
+// from the cell buffer the compute passes update.
+
+uniform mat4 orthoMat;
+uniform ivec2 size; // rows, cols
+uniform vec3 colors[5];
+uniform float pointSize;
+uniform usamplerBuffer cells;
+
+out vec3 color;
+
+void main(void)
+{
+	int row = gl_VertexID / size.y, col = gl_VertexID % size.y;
+	vec2 grid = vec2(20.0 / size.y, 19.0 / size.x); // as tileModel()
+
+	color = colors[texelFetch(cells, gl_VertexID).r];
+
+	gl_PointSize = pointSize;
+	gl_Position = orthoMat * vec4(-10.0 + (col + 0.5) * grid.x, 10.0 - (row + 0.5) * grid.y, -10, 1);
+}
@@ -0,0 +1,18 @@
+#version 120
+
+// One point sprite per tile, textured from the impostor atlas
+
+uniform mat4 orthoMat;
+
+attribute vec3 inPoint; // x, y in world units, size in pixels
+attribute vec2 inCell;  // atlas column (spin angle) and row (color)
+
+varying vec2 cell;
+
+void main(void)
+{
+	cell = inCell;
+
+	gl_PointSize = inPoint.z;
+	gl_Position = orthoMat * vec4(inPoint.xy, -10, 1); // the depth of the tiles
+}
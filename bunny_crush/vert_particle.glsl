@@ -0,0 +1,21 @@
+#version 120
+
+uniform mat4 orthoMat;
+uniform vec3 colors[5];
+uniform float pointSize;
+
+attribute float inX;
+attribute float inY;
+attribute float inLife;
+attribute float inColor;
+
+varying vec4 color;
+
+void main(void)
+{
+	float life = clamp(inLife, 0.0, 1.0);
+	color = vec4(colors[int(inColor)], life);
+
+	gl_PointSize = pointSize * (0.5 + 0.5 * life); // shrink as they fade
+	gl_Position = orthoMat * vec4(inX, inY, 0, 1);
+}
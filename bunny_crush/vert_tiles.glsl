@@ -0,0 +1,47 @@
+#version 120
+
+// vert0.glsl with the per-tile values as instanced attributes, so the tiles
+// of every board are drawn with one call per mesh
+
+vec3 lightPos = vec3(5, 5, 5);
+vec3 eyePos = vec3(0, 0, 0);
+
+uniform float intensity;
+vec3 I = vec3(intensity, intensity, intensity);
+vec3 Iamb = vec3(0.8, 0.8, 0.8);
+
+vec3 ka = vec3(0.1, 0.1, 0.1);
+vec3 ks = vec3(0.8, 0.8, 0.8);
+
+uniform mat4 orthoMat;
+
+attribute vec3 inVertex;
+attribute vec3 inNormal;
+
+attribute mat4 inModelingMat;
+attribute vec3 inKd;
+attribute vec4 inRegion; // clip space offset (xy) and scale (zw)
+
+void main(void)
+{
+	vec4 p = inModelingMat * vec4(inVertex, 1); // translate to world coordinates
+	vec3 Lorg = lightPos - vec3(p);
+	vec3 L = normalize(Lorg);
+	vec3 V = normalize(eyePos - vec3(p));
+	vec3 H = normalize(L + V);
+	// tiles are only rotated and uniformly scaled, so the modeling matrix
+	// itself transforms the normals up to length
+	vec3 N = normalize(mat3(inModelingMat) * inNormal);
+	float NdotL = dot(N, L);
+	float NdotH = dot(N, H);
+
+	float d = length(Lorg);
+	vec3 diffuseColor = I * inKd * max(0, NdotL) / (d * d);
+	vec3 ambientColor = Iamb * ka;
+	vec3 specularColor = I * ks * pow(max(0, NdotH), 20) / (d * d);
+
+	gl_FrontColor = vec4(diffuseColor + ambientColor + specularColor, 1);
+
+	gl_Position = orthoMat * p;
+	gl_Position.xy = gl_Position.xy * inRegion.zw + inRegion.xy * gl_Position.w;
+}